@@ -0,0 +1,606 @@
+#include "redis_test.h"
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <boost/asio.hpp>
+#include <boost/asio/use_future.hpp>
+#ifdef BOOST_ASIO_HAS_CO_AWAIT
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "reply_scanner.h"
+#include "memory_budget.h"
+#include "asio_adaptor.h"
+
+namespace redis_test
+{
+
+namespace {
+
+using boost::asio::ip::tcp;
+
+// accepts 'connections' connections on a loopback port one after the other, and runs 'serve' on each
+struct loopback_server
+{
+    typedef std::function<void(tcp::socket&)> session_function;
+
+    loopback_server(session_function serve, size_t connections = 1)
+        : acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), expected(connections), accepted(0)
+    {
+        port = acceptor.local_endpoint().port();
+        server = std::thread([this, serve] {
+            for (size_t i = 0; i < expected; i++) {
+                tcp::socket socket(io);
+                boost::system::error_code ec;
+                acceptor.accept(socket, ec);
+                accepted++;
+                if (!ec) {
+                    serve(socket);
+                }
+            }
+        });
+    }
+
+    ~loopback_server()
+    {
+        // ends the accepts of connections which never came
+        while (accepted < expected) {
+            tcp::socket hang_up(io);
+            boost::system::error_code ec;
+            hang_up.connect(acceptor.local_endpoint(), ec);
+            hang_up.close(ec);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        server.join();
+    }
+
+    boost::asio::io_service io;
+    tcp::acceptor acceptor;
+    uint16_t port;
+    size_t expected;
+    std::atomic<size_t> accepted;
+    std::thread server;
+};
+
+// answers every request of a connection with 'reply(request)', until the client closes it
+loopback_server::session_function redis_replies(std::function<std::string(const std::string&)> reply)
+{
+    return [reply](tcp::socket& socket) {
+        std::string input;
+        char buffer[4096];
+
+        for (;;) {
+            redis::reply_scanner scanner;
+            auto state = scanner.scan(redis::const_buffer_view(input.data(), input.size()));
+            while (state == redis::reply_scanner::incomplete) {
+                boost::system::error_code ec;
+                auto size = socket.read_some(boost::asio::buffer(buffer), ec);
+                if (ec) {
+                    return;
+                }
+                input.append(buffer, size);
+                state = scanner.scan(redis::const_buffer_view(input.data(), input.size()));
+            }
+
+            auto request = input.substr(0, scanner.reply_size());
+            input.erase(0, scanner.reply_size());
+            boost::system::error_code ec;
+            boost::asio::write(socket, boost::asio::buffer(reply(request)), ec);
+            if (ec) {
+                return;
+            }
+        }
+    };
+}
+
+std::string bulk_string(const std::string& value)
+{
+    return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+// replies with 'size' bytes to GET <size>, and +OK to anything else
+std::string sized_reply(const std::string& request)
+{
+    if (request.find("GET") == std::string::npos) {
+        return "+OK\r\n";
+    }
+    auto key = request.substr(request.rfind("\r\n", request.size() - 3) + 2);
+    return bulk_string(std::string(std::stoul(key), 'x'));
+}
+
+// GET through reply_builder, which takes bulk data from the read buffer instead of receiving it in place
+std::error_code get_sized(asio_stream_adaptor& stream, size_t size, reply_builder& reply)
+{
+    auto ec = redis::format_command(stream, "GET", std::to_string(size));
+    if (ec) {
+        return ec;
+    }
+    if (!stream.flush()) {
+        return redis::error::stream_error;
+    }
+    return redis::parse(stream, reply);
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("asio_adaptor_request", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies([](const std::string&) { return bulk_string("value"); }));
+
+    redis::session<asio_stream_adaptor> session;
+    REQUIRE(session.connect("127.0.0.1", server.port));
+
+    redis::GET get;
+    get.key = "key";
+    REQUIRE(!session.request(get));
+    REQUIRE(std::string(get.reply.result.data.begin(), get.reply.result.data.end()) == "value");
+    REQUIRE(session.close());
+}
+
+TEST_CASE("asio_adaptor_resolver_cache", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies([](const std::string&) { return bulk_string("value"); }));
+
+    asio_resolver_cache cache;
+    tcp::endpoint endpoint;
+    boost::system::error_code err;
+    REQUIRE(cache.resolve("localhost", server.port, endpoint, err));
+    REQUIRE(endpoint.port() == server.port);
+    REQUIRE(cache.resolve("localhost", server.port, endpoint, err));
+    REQUIRE(cache.resolutions() == 1);
+
+    // entries expire at once without a ttl, and clear drops them
+    asio_resolver_cache uncached(std::chrono::seconds(0));
+    REQUIRE(uncached.resolve("localhost", server.port, endpoint, err));
+    REQUIRE(uncached.resolve("localhost", server.port, endpoint, err));
+    REQUIRE(uncached.resolutions() == 2);
+
+    cache.clear();
+    REQUIRE(cache.resolve("localhost", server.port, endpoint, err));
+    REQUIRE(cache.resolutions() == 2);
+
+    redis::session<asio_stream_adaptor> session;
+    REQUIRE(session.connect("localhost", server.port, cache));
+    REQUIRE(cache.resolutions() == 2);
+
+    redis::GET get;
+    get.key = "key";
+    REQUIRE(!session.request(get));
+    REQUIRE(session.close());
+}
+
+TEST_CASE("asio_adaptor_connect_all", "[asio_adaptor]")
+{
+    // a port nobody listens on
+    uint16_t closed_port = 0;
+    {
+        boost::asio::io_service io;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        closed_port = acceptor.local_endpoint().port();
+    }
+
+    loopback_server server(redis_replies([](const std::string&) { return bulk_string("value"); }), 2);
+
+    asio_stream_adaptor first, second, refused, open;
+    REQUIRE(open.connect("127.0.0.1", server.port));
+
+    asio_resolver_cache cache;
+    auto start = std::chrono::steady_clock::now();
+    auto report = asio_stream_adaptor::connect_all({
+        { &first, "127.0.0.1", server.port },
+        { &second, "127.0.0.1", server.port },
+        { &refused, "127.0.0.1", closed_port },
+        { &open, "127.0.0.1", server.port },
+    }, 5, &cache);
+
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5)); // the refused connect does not wait for the time out
+    REQUIRE(report.connected == 2);
+    REQUIRE(report.failed == 2);
+    REQUIRE(report.resolutions == 2); // once per host and port
+    REQUIRE(cache.resolutions() == 2);
+
+    REQUIRE(first.is_open());
+    REQUIRE(second.is_open());
+    REQUIRE(!refused.is_open());
+    REQUIRE(refused.stream_error() == boost::asio::error::connection_refused);
+    REQUIRE(open.stream_error() == boost::asio::error::already_connected);
+
+    open.close();
+    first.close();
+    second.close();
+}
+
+TEST_CASE("asio_adaptor_concurrent_connect", "[asio_adaptor]")
+{
+    // connects of many threads at once, as by the shards of sharded_client and the connections of connection_pool
+    const size_t thread_count = 16;
+    const size_t rounds = 50;
+    loopback_server server([](tcp::socket&) {}, thread_count * rounds * 3);
+
+    asio_resolver_cache cache;
+    std::atomic<size_t> connected(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back([&] {
+            for (size_t j = 0; j < rounds; j++) {
+                asio_stream_adaptor single, first, second;
+                if (single.connect("127.0.0.1", server.port, cache) && single.close()) {
+                    connected++;
+                }
+
+                auto report = asio_stream_adaptor::connect_all({
+                    { &first, "127.0.0.1", server.port },
+                    { &second, "127.0.0.1", server.port },
+                }, 5, &cache);
+                connected += report.connected;
+                first.close();
+                second.close();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(connected == thread_count * rounds * 3);
+}
+
+TEST_CASE("asio_adaptor_memory_limits", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies(sized_reply));
+
+    redis::memory_budget budget(1 << 20);
+    asio_stream_adaptor::memory_limits limits;
+    limits.max_write_buffer = 8192;
+    limits.max_read_buffer = 16384;
+    limits.budget = &budget;
+
+    asio_stream_adaptor stream(4096);
+    stream.set_memory_limits(limits);
+    REQUIRE(stream.connect("127.0.0.1", server.port));
+
+    SECTION("write over max_write_buffer") {
+        std::string value(65536, 'v');
+        REQUIRE(!redis::format_command(stream, "SET", "key", value));
+
+        // the value went to the socket instead of the buffer
+        REQUIRE(stream.pending_output() <= limits.max_write_buffer);
+        REQUIRE(stream.buffer_memory() <= limits.max_write_buffer);
+        REQUIRE(stream.flush());
+
+        reply_builder reply;
+        REQUIRE(!redis::parse(stream, reply));
+        REQUIRE(reply.root->str == "OK");
+    }
+
+    SECTION("read over max_read_buffer") {
+        reply_builder reply;
+        REQUIRE(get_sized(stream, 100000, reply));
+        REQUIRE(stream.stream_error() == boost::asio::error::no_buffer_space);
+    }
+
+    SECTION("budget released on close") {
+        reply_builder reply;
+        REQUIRE(!get_sized(stream, 12000, reply));
+        REQUIRE(reply.root->bulk.size() == 12000);
+
+        // the read buffer grew beyond the initial buffers
+        REQUIRE(stream.charged_memory() > 0);
+        REQUIRE(budget.used() == stream.charged_memory());
+        REQUIRE(stream.charged_memory() == stream.buffer_memory() - 2 * 4096); // by the pooled blocks, beyond the initial ones
+
+        REQUIRE(stream.close());
+        REQUIRE(stream.charged_memory() == 0);
+        REQUIRE(budget.used() == 0);
+    }
+
+    stream.close();
+}
+
+TEST_CASE("asio_adaptor_buffer_memory", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies(sized_reply));
+
+    asio_stream_adaptor stream(4096);
+    stream.set_shrink_threshold(65536);
+    REQUIRE(stream.connect("127.0.0.1", server.port));
+
+    // the whole reply read at once needs a read buffer beyond the threshold
+    REQUIRE(!redis::format_command(stream, "GET", "200000"));
+    REQUIRE(stream.flush());
+    auto reply = stream.read(bulk_string(std::string(200000, 'x')).size());
+    REQUIRE(reply.valid());
+    auto grown = stream.buffer_memory();
+    REQUIRE(grown >= 200000);
+
+    // the large buffer is replaced once the next reply fits below the threshold
+    reply_builder small;
+    REQUIRE(!get_sized(stream, 100, small));
+    REQUIRE(small.root->bulk.size() == 100);
+    REQUIRE(stream.buffer_memory() < grown);
+    REQUIRE(stream.buffer_memory() <= 2 * 65536);
+
+    // an idle connection gives all of its buffers back, and allocates them again on demand
+    REQUIRE(stream.release_idle_buffers(std::chrono::hours(1)) == 0);
+    auto held = stream.buffer_memory();
+    REQUIRE(stream.release_idle_buffers(std::chrono::seconds(0)) == held);
+    REQUIRE(stream.buffer_memory() == 0);
+
+    reply_builder again;
+    REQUIRE(!get_sized(stream, 100, again));
+    REQUIRE(again.root->bulk.size() == 100);
+    REQUIRE(stream.buffer_memory() > 0);
+
+    REQUIRE(stream.close());
+    REQUIRE(stream.buffer_memory() == 0);
+}
+
+TEST_CASE("asio_adaptor_adaptive_read_buffer", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies(sized_reply));
+
+    asio_stream_adaptor stream(4096);
+    stream.enable_adaptive_read_buffer(0.9, 4);
+    REQUIRE(stream.connect("127.0.0.1", server.port));
+    REQUIRE(stream.preferred_read_buffer_size() == 4096);
+
+    for (int i = 0; i < 4; i++) {
+        reply_builder reply;
+        REQUIRE(!get_sized(stream, 30000, reply));
+    }
+    // a reply may arrive in more than one burst
+    REQUIRE(stream.read_sizes().samples() >= 4);
+    auto preferred = stream.preferred_read_buffer_size();
+    REQUIRE(preferred > 4096);
+    REQUIRE(preferred <= 32768);
+
+    // a fresh read buffer is allocated at the preferred size at once, even for a small reply
+    REQUIRE(stream.release_idle_buffers(std::chrono::seconds(0)) > 0);
+    reply_builder first;
+    REQUIRE(!get_sized(stream, 100, first));
+    auto grown = stream.buffer_memory();
+    REQUIRE(grown >= preferred);
+
+    // once small replies dominate, the drained buffer is replaced by a small one
+    for (int i = 0; i < 2000 && stream.preferred_read_buffer_size() > 4096; i++) {
+        reply_builder reply;
+        REQUIRE(!get_sized(stream, 100, reply));
+    }
+    REQUIRE(stream.preferred_read_buffer_size() == 4096);
+
+    reply_builder last;
+    REQUIRE(!get_sized(stream, 100, last));
+    REQUIRE(stream.buffer_memory() < grown);
+
+    REQUIRE(stream.close());
+}
+
+#ifdef REDIS_ASIO_ASYNC_REQUEST
+TEST_CASE("asio_adaptor_async_request", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies([](const std::string& request) {
+        return request.find("GET") != std::string::npos ? bulk_string(std::string(5000, 'x')) : std::string("+OK\r\n");
+    }));
+
+    // a small initial buffer, so that the reply takes several reads and a larger buffer
+    boost::asio::io_service io;
+    asio_stream_adaptor stream(io, 64);
+    REQUIRE(stream.connect("127.0.0.1", server.port));
+
+    SECTION("callback") {
+        redis::SET<std::string> set;
+        set.key = "key";
+        set.value = "value";
+
+        std::error_code result = redis::error::stream_error;
+        int calls = 0;
+        stream.async_request(set, [&](std::error_code ec) {
+            result = ec;
+            calls++;
+        });
+        REQUIRE(calls == 0); // never inside async_request
+
+        io.run();
+        REQUIRE(calls == 1);
+        REQUIRE(!result);
+        REQUIRE(set.reply.result);
+    }
+
+    SECTION("future") {
+        auto work = std::make_shared<boost::asio::io_service::work>(io);
+        std::thread runner([&] { io.run(); });
+
+        redis::GET get;
+        get.key = "key";
+        auto ec = stream.async_request(get, boost::asio::use_future).get();
+        REQUIRE(!ec);
+        REQUIRE(get.reply.result.data.size() == 5000);
+
+        // the next request reuses the connection and its grown buffer
+        redis::GET again;
+        again.key = "key";
+        REQUIRE(!stream.async_request(again, boost::asio::use_future).get());
+        REQUIRE(again.reply.result.data.size() == 5000);
+
+        work.reset();
+        runner.join();
+    }
+
+#ifdef BOOST_ASIO_HAS_CO_AWAIT
+    SECTION("awaitable") {
+        redis::GET get;
+        get.key = "key";
+        std::error_code result = redis::error::stream_error;
+
+        boost::asio::co_spawn(io, [&]() -> boost::asio::awaitable<void> {
+            result = co_await stream.async_request(get, boost::asio::use_awaitable);
+        }, boost::asio::detached);
+        io.run();
+
+        REQUIRE(!result);
+        REQUIRE(get.reply.result.data.size() == 5000);
+    }
+#endif
+
+    SECTION("closed stream") {
+        REQUIRE(stream.close());
+
+        redis::GET get;
+        get.key = "key";
+        std::error_code result;
+        stream.async_request(get, [&](std::error_code ec) { result = ec; });
+        io.run();
+        REQUIRE(result == redis::error::stream_not_initialized);
+    }
+
+    stream.close();
+}
+#endif
+
+#ifdef __linux__
+TEST_CASE("asio_adaptor_zero_copy", "[asio_adaptor]")
+{
+    const size_t chunk = 65536;
+    const size_t rounds = 16;
+    std::atomic<size_t> received(0);
+    std::atomic<bool> intact(true);
+
+    // the pattern runs across chunks, so that the receiver can check every byte
+    loopback_server server([&](tcp::socket& socket) {
+        char buffer[16384];
+        boost::system::error_code ec;
+        for (;;) {
+            auto size = socket.read_some(boost::asio::buffer(buffer), ec);
+            if (ec) {
+                return;
+            }
+            for (size_t i = 0; i < size; i++) {
+                if (buffer[i] != static_cast<char>((received + i) % 251)) {
+                    intact = false;
+                }
+            }
+            received += size;
+        }
+    });
+
+    asio_stream_adaptor stream;
+    REQUIRE(stream.connect("127.0.0.1", server.port));
+    REQUIRE(stream.enable_zero_copy(4096));
+
+    std::vector<char> data(chunk);
+    size_t written = 0;
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < chunk; i++) {
+            data[i] = static_cast<char>((written + i) % 251);
+        }
+        REQUIRE(stream.write(redis::const_buffer_view(data.data(), data.size())));
+        REQUIRE(stream.flush());
+        written += chunk;
+
+        // a flushed buffer stays pinned until the kernel reports its completion, and their number is bounded
+        REQUIRE(stream.pinned_buffer_count() <= 9);
+    }
+
+    for (int i = 0; i < 5000 && received < written; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(received == written);
+    REQUIRE(intact);
+
+    // the peer consumed everything, so the next zero-copy flush reaps the completions of all earlier ones
+    for (size_t i = 0; i < chunk; i++) {
+        data[i] = static_cast<char>((written + i) % 251);
+    }
+    REQUIRE(stream.write(redis::const_buffer_view(data.data(), data.size())));
+    REQUIRE(stream.flush());
+    written += chunk;
+    REQUIRE(stream.pinned_buffer_count() <= 1);
+
+    // flushes below the threshold are copied, and pin nothing
+    REQUIRE(stream.write(redis::const_buffer_view(data.data(), 100)));
+    auto pinned = stream.pinned_buffer_count();
+    REQUIRE(stream.flush());
+    REQUIRE(stream.pinned_buffer_count() == pinned);
+
+    REQUIRE(stream.close());
+}
+
+TEST_CASE("asio_adaptor_stalled_peer", "[asio_adaptor]")
+{
+    // the peer never reads, so the socket buffers fill up
+    std::atomic<bool> done(false);
+    loopback_server server([&](tcp::socket&) {
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    auto file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    REQUIRE(::ftruncate(fileno(file), 64 << 20) == 0);
+
+    asio_stream_adaptor stream;
+    REQUIRE(stream.connect("127.0.0.1", server.port, 1));
+
+    SECTION("sendfile") {
+        redis::file_region region = { fileno(file), 0, 64 << 20 };
+        REQUIRE(stream.write_file(region));
+    }
+
+    SECTION("zero copy") {
+        REQUIRE(stream.enable_zero_copy(4096));
+        std::vector<char> data(64 << 20);
+        REQUIRE(stream.write(redis::const_buffer_view(data.data(), data.size())));
+    }
+
+    // the flush fails after the time-out of the connection instead of waiting for the peer forever
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(!stream.flush());
+    REQUIRE(stream.stream_error() == boost::asio::error::timed_out);
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+
+    done = true;
+    stream.close();
+    std::fclose(file);
+}
+
+TEST_CASE("asio_adaptor_busy_poll", "[asio_adaptor]")
+{
+    loopback_server server(redis_replies([](const std::string&) { return bulk_string("value"); }));
+
+    // SO_BUSY_POLL needs CAP_NET_ADMIN above net.core.busy_read, and without it the connection still spins
+    redis::session<asio_stream_adaptor> session;
+    REQUIRE(session.enable_busy_poll(std::chrono::microseconds(50000), false, 50));
+    REQUIRE(session.connect("127.0.0.1", server.port));
+
+    for (int i = 0; i < 10; i++) {
+        redis::GET get;
+        get.key = "key";
+        REQUIRE(!session.request(get));
+        REQUIRE(std::string(get.reply.result.data.begin(), get.reply.result.data.end()) == "value");
+    }
+
+    auto& stats = session.busy_poll_statistics();
+    REQUIRE(stats.spins > 0);
+    REQUIRE(stats.hits + stats.misses >= 10);
+    REQUIRE(session.close());
+    REQUIRE(!session.kernel_busy_poll());
+}
+#endif
+
+} // namespace "redis_test"
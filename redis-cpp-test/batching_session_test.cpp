@@ -0,0 +1,151 @@
+#include "redis_test.h"
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <iterator>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "batching_session.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+TEST_CASE("batching_session_count_threshold", "[batching_session]")
+{
+    redis::batching_session<mock_stream> conn;
+    conn.max_batch_commands = 2;
+    conn.linger = std::chrono::hours(1);
+
+    auto& stream = conn.connection();
+    stream.more_input(":1\r\n:2\r\n-ERR wrong\r\n");
+
+    redis::STRLEN first, second, third;
+    first.key = "a";
+    second.key = "b";
+    third.key = "c";
+
+    auto f1 = conn.send(first);
+    REQUIRE(stream.flushed_offsets.empty());
+
+    auto f2 = conn.send(second);
+    REQUIRE(stream.flushed_offsets.size() == 1);
+
+    auto f3 = conn.send(third);
+    REQUIRE(stream.flushed_offsets.size() == 1);
+    REQUIRE(!f1.is_ready());
+    REQUIRE(conn.pending() == 3);
+
+    // waiting on the buffered command flushes it and parses every reply before it
+    REQUIRE(f3.get() == redis::error::error_reply);
+    REQUIRE(stream.flushed_offsets.size() == 2);
+    REQUIRE(f1.is_ready());
+    REQUIRE(f2.is_ready());
+    REQUIRE(!f1.get());
+    REQUIRE(!f2.get());
+    REQUIRE(first.reply.result == 1);
+    REQUIRE(second.reply.result == 2);
+    REQUIRE(conn.pending() == 0);
+
+    REQUIRE(check_equal(
+        "*2\r\n$6\r\nSTRLEN\r\n$1\r\na\r\n"
+        "*2\r\n$6\r\nSTRLEN\r\n$1\r\nb\r\n"
+        "*2\r\n$6\r\nSTRLEN\r\n$1\r\nc\r\n", stream));
+}
+
+TEST_CASE("batching_session_byte_threshold_and_linger", "[batching_session]")
+{
+    redis::batching_session<mock_stream> conn;
+    conn.max_batch_bytes = 64;
+    conn.linger = std::chrono::milliseconds(5);
+
+    auto& stream = conn.connection();
+    stream.more_input("+OK\r\n+OK\r\n");
+
+    redis::SET<std::string> big;
+    big.key = "big";
+    big.value = std::string(100, 'x');
+    auto f1 = conn.send(big);
+    REQUIRE(stream.flushed_offsets.size() == 1);
+
+    // poll parses what already arrived without waiting
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(f1.is_ready());
+    REQUIRE(!f1.get());
+
+    redis::SET<std::string> small;
+    small.key = "small";
+    small.value = "x";
+    auto f2 = conn.send(small);
+    REQUIRE(stream.flushed_offsets.size() == 1);
+    REQUIRE(conn.poll() == 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(stream.flushed_offsets.size() == 2);
+    REQUIRE(!f2.get());
+    REQUIRE(small.reply.result);
+}
+
+TEST_CASE("batching_session_stream_failure", "[batching_session]")
+{
+    redis::batching_session<mock_stream> conn;
+    auto& stream = conn.connection();
+    stream.more_input(":1\r\n");
+
+    redis::STRLEN first, second;
+    first.key = "a";
+    second.key = "b";
+    auto f1 = conn.send(first);
+    auto f2 = conn.send(second);
+
+    // the second reply never arrives
+    REQUIRE(f2.get() == redis::error::stream_error);
+    REQUIRE(!f1.get());
+    REQUIRE(!conn.is_open());
+
+    auto f3 = conn.send(first);
+    REQUIRE(f3.is_ready());
+    REQUIRE(f3.get() == redis::error::stream_not_initialized);
+}
+
+TEST_CASE("batching_session_poll_partial_reply", "[batching_session]")
+{
+    redis::batching_session<mock_stream> conn;
+    auto& stream = conn.connection();
+
+    redis::GET first, second;
+    first.key = "a";
+    second.key = "b";
+    auto f1 = conn.send(first);
+    auto f2 = conn.send(second);
+    REQUIRE(conn.flush());
+
+    // the second reply is cut in its bulk data, so parsing it would wait for the rest
+    stream.more_input("$5\r\nfirst\r\n$6\r\nsec");
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(f1.is_ready());
+    REQUIRE(!f2.is_ready());
+    REQUIRE(conn.poll() == 0);
+
+    stream.more_input("ond\r\n");
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(!f2.get());
+    REQUIRE(std::string(begin(second.reply.result.data), end(second.reply.result.data)) == "second");
+}
+
+TEST_CASE("batching_session_invalid_future", "[batching_session]")
+{
+    redis::batching_session<mock_stream>::reply_future future;
+    REQUIRE(!future.valid());
+    REQUIRE(!future.is_ready());
+    REQUIRE(future.get() == redis::error::stream_not_initialized);
+}
+
+} // namespace "redis_test"
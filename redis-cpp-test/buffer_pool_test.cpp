@@ -0,0 +1,128 @@
+#include "redis_test.h"
+
+#include <thread>
+#include <vector>
+#include <string>
+
+#include <catch.hpp>
+
+#include "buffer_pool.h"
+
+namespace redis_test
+{
+
+TEST_CASE("buffer_pool_size_classes", "[buffer_pool]")
+{
+    auto& pool = redis::buffer_pool::instance();
+
+    size_t size = 5000;
+    auto block = pool.allocate(size);
+    REQUIRE(block != nullptr);
+    REQUIRE(size == 8192);
+
+    size_t small = 1;
+    auto small_block = pool.allocate(small);
+    REQUIRE(small == redis::buffer_pool::min_block_size);
+
+    pool.deallocate(small_block, small);
+    pool.deallocate(block, size);
+}
+
+TEST_CASE("buffer_pool_thread_cache_reuse", "[buffer_pool]")
+{
+    auto& pool = redis::buffer_pool::instance();
+
+    size_t size = 16384;
+    auto block = pool.allocate(size);
+    pool.deallocate(block, size);
+
+    auto hits = pool.stats().cache_hits;
+    size_t again = 16384;
+    REQUIRE(pool.allocate(again) == block);
+    REQUIRE(pool.stats().cache_hits == hits + 1);
+    pool.deallocate(block, again);
+}
+
+TEST_CASE("buffer_pool_direct_allocation", "[buffer_pool]")
+{
+    auto& pool = redis::buffer_pool::instance();
+    auto before = pool.stats().direct_in_use;
+
+    size_t size = redis::buffer_pool::max_block_size + 1;
+    auto block = pool.allocate(size);
+    REQUIRE(size == redis::buffer_pool::max_block_size + 1);
+    REQUIRE(pool.stats().direct_in_use == before + size);
+
+    pool.deallocate(block, size);
+    REQUIRE(pool.stats().direct_in_use == before);
+}
+
+TEST_CASE("pooled_buffer_resize", "[buffer_pool]")
+{
+    redis::pooled_buffer buffer(100);
+    REQUIRE(buffer.size() == 100);
+    REQUIRE(buffer.capacity() == redis::buffer_pool::min_block_size);
+
+    std::string text = "keeps the content";
+    std::copy(text.begin(), text.end(), buffer.begin());
+
+    buffer.resize(4000); // fits the block
+    REQUIRE(buffer.capacity() == redis::buffer_pool::min_block_size);
+
+    buffer.resize(100000);
+    REQUIRE(buffer.size() == 100000);
+    REQUIRE(buffer.capacity() == 131072);
+    REQUIRE(std::string(buffer.begin(), buffer.begin() + text.size()) == text);
+
+    redis::pooled_buffer moved(std::move(buffer));
+    REQUIRE(buffer.empty());
+    REQUIRE(buffer.data() == nullptr);
+    REQUIRE(moved.size() == 100000);
+
+    moved.release();
+    REQUIRE(moved.empty());
+    REQUIRE(moved.capacity() == 0);
+}
+
+TEST_CASE("buffer_pool_threads", "[buffer_pool]")
+{
+    auto& pool = redis::buffer_pool::instance();
+    auto before = pool.stats().pooled_in_use;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t] {
+            std::vector<redis::pooled_buffer> buffers;
+            for (int i = 0; i < 2000; i++) {
+                buffers.emplace_back(static_cast<size_t>(1000 * (t + 1) + i));
+                buffers.back().begin()[0] = static_cast<char>(i);
+                if (buffers.size() > 20) {
+                    buffers.erase(buffers.begin(), buffers.begin() + 10);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // every block went back, either to a thread cache or to the shared free lists
+    REQUIRE(pool.stats().pooled_in_use == before);
+    REQUIRE(pool.stats().slab_allocations > 0);
+}
+
+TEST_CASE("pooled_buffer_outlives_thread_cache", "[buffer_pool]")
+{
+    auto& pool = redis::buffer_pool::instance();
+    auto before = pool.stats().pooled_in_use;
+
+    // the buffer is constructed before the thread cache, so it is destroyed after it
+    std::thread([] {
+        thread_local redis::pooled_buffer early;
+        early.resize(8192);
+    }).join();
+
+    REQUIRE(pool.stats().pooled_in_use == before);
+}
+
+} // namespace "redis_test"
@@ -346,6 +346,25 @@ TEST_CASE("sorted_set_command", "[command]")
     }
 }
 
+TEST_CASE("read_only_command", "[command]")
+{
+    REQUIRE(redis::GET().is_read_only());
+    REQUIRE(redis::EXISTS().is_read_only());
+    REQUIRE(redis::HGET().is_read_only());
+    REQUIRE(redis::HGETALL().is_read_only());
+    REQUIRE(redis::LRANGE().is_read_only());
+    REQUIRE(redis::SISMEMBER<std::string>().is_read_only());
+    REQUIRE(redis::ZSCORE<std::string>().is_read_only());
+    REQUIRE(redis::ZRANGEBYSCORE().is_read_only());
+
+    REQUIRE(!redis::DEL().is_read_only());
+    REQUIRE(!redis::SET<std::string>().is_read_only());
+    REQUIRE(!redis::GETSET<std::string>().is_read_only());
+    REQUIRE(!redis::HDEL().is_read_only());
+    REQUIRE(!redis::LPOP().is_read_only());
+    REQUIRE(!redis::ZREMRANGEBYRANK().is_read_only());
+}
+
 void test_pubsub_command()
 {
     // TODO
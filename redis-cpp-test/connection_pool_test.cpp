@@ -0,0 +1,152 @@
+#include "redis_test.h"
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "connection_pool.h"
+
+namespace redis_test
+{
+
+namespace {
+
+struct pooled_stream : public mock_stream
+{
+    pooled_stream() : users(0)
+    {
+        is_opened = false;
+    }
+
+    std::atomic<int> users;
+};
+
+typedef redis::connection_pool<pooled_stream> test_pool;
+
+} // the end of anonymous namespace
+
+TEST_CASE("connection_pool_reuses_connections", "[connection_pool]")
+{
+    int connects = 0;
+    test_pool pool([&](redis::session<pooled_stream>& connection) {
+        connects++;
+        connection.is_opened = true;
+        return true;
+    });
+
+    redis::session<pooled_stream>* first = nullptr;
+    {
+        auto c = pool.checkout();
+        REQUIRE(c);
+        REQUIRE(c->is_open());
+        first = &*c;
+    }
+
+    // the same thread gets the connection back from its cache slot
+    {
+        auto c = pool.checkout();
+        REQUIRE(&*c == first);
+
+        // a second connection is created while the first one is checked out
+        auto d = pool.checkout();
+        REQUIRE(d);
+        REQUIRE(&*d != first);
+
+        // a broken connection is connected again at the next checkout
+        d->close();
+    }
+
+    {
+        auto c = pool.checkout();
+        auto d = pool.checkout();
+        REQUIRE(c->is_open());
+        REQUIRE(d->is_open());
+    }
+
+    auto stats = pool.stats();
+    REQUIRE(stats.checkouts == 5);
+    REQUIRE(stats.created == 2);
+    REQUIRE(stats.reconnects == 1);
+    REQUIRE(stats.thread_cache_hits == 2);
+    REQUIRE(stats.shared_hits == 1);
+    REQUIRE(stats.failures == 0);
+    REQUIRE(connects == 3);
+    REQUIRE(pool.size() == 2);
+}
+
+TEST_CASE("connection_pool_times_out", "[connection_pool]")
+{
+    test_pool::options opts;
+    opts.max_size = 1;
+    opts.wait_timeout = std::chrono::milliseconds(10);
+
+    test_pool pool([](redis::session<pooled_stream>& connection) {
+        connection.is_opened = true;
+        return true;
+    }, opts);
+
+    auto c = pool.checkout();
+    REQUIRE(c);
+    REQUIRE(!pool.checkout());
+
+    auto stats = pool.stats();
+    REQUIRE(stats.waits == 1);
+    REQUIRE(stats.failures == 1);
+    REQUIRE(stats.wait_time >= std::chrono::milliseconds(10));
+}
+
+TEST_CASE("connection_pool_shared_by_threads", "[connection_pool]")
+{
+    test_pool::options opts;
+    opts.max_size = 3;
+    opts.thread_cache_slots = 4;
+    opts.wait_timeout = std::chrono::milliseconds(10000);
+
+    test_pool pool([](redis::session<pooled_stream>& connection) {
+        connection.is_opened = true;
+        return true;
+    }, opts);
+
+    // a connection should never be used by two threads at once
+    const int thread_count = 8;
+    const int count = 2000;
+    std::atomic<int> shared_use(0), failures(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < count; i++) {
+                auto c = pool.checkout();
+                if (!c) {
+                    failures++;
+                    continue;
+                }
+                if (c->users.fetch_add(1) != 0) {
+                    shared_use++;
+                }
+                if (i % 16 == 0) {
+                    std::this_thread::yield();
+                }
+                c->users.fetch_sub(1);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(shared_use == 0);
+    REQUIRE(failures == 0);
+    REQUIRE(pool.size() <= 3);
+
+    auto stats = pool.stats();
+    REQUIRE(stats.checkouts == thread_count * count);
+    REQUIRE(stats.hit_rate() > 0);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,130 @@
+#include "redis_test.h"
+
+#include "coroutine_session.h"
+
+#ifdef REDIS_HAS_COROUTINES
+
+#include <string>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+namespace {
+
+// fire-and-forget coroutine type, enough to drive the session in tests
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() { return detached_task(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+detached_task set_and_get(redis::coroutine_session<mock_stream>& conn, int id, std::string& output)
+{
+    redis::SET<std::string> set;
+    set.key = "key" + std::to_string(id);
+    set.value = "value" + std::to_string(id);
+    if (co_await conn.request(set) || !set.reply.result) {
+        output = "SET failed";
+        co_return;
+    }
+
+    redis::GET get;
+    get.key = set.key;
+    auto ec = co_await conn.request(get);
+    output = ec ? "GET failed" : std::string(begin(get.reply.result.data), end(get.reply.result.data));
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("coroutine_session_pipelines_coroutines", "[coroutine_session]")
+{
+    redis::coroutine_session<mock_stream> conn;
+    std::string outputs[3];
+
+    for (int i = 0; i < 3; i++) {
+        set_and_get(conn, i, outputs[i]);
+    }
+    REQUIRE(conn.pending() == 3);
+
+    // every SET goes in the first pipeline, and the GETs issued after resuming go in the second one
+    auto& stream = conn.connection();
+    stream.more_input("+OK\r\n+OK\r\n+OK\r\n$6\r\nvalue0\r\n$6\r\nvalue1\r\n$6\r\nvalue2\r\n");
+
+    REQUIRE(conn.poll() == 3);
+    REQUIRE(conn.pending() == 3);
+    REQUIRE(conn.poll() == 3);
+    REQUIRE(conn.pending() == 0);
+    REQUIRE(conn.poll() == 0);
+
+    REQUIRE(stream.flushed_offsets.size() == 2);
+    REQUIRE(outputs[0] == "value0");
+    REQUIRE(outputs[1] == "value1");
+    REQUIRE(outputs[2] == "value2");
+}
+
+TEST_CASE("coroutine_session_poll_does_not_wait", "[coroutine_session]")
+{
+    redis::coroutine_session<mock_stream> conn;
+    std::string outputs[2];
+
+    for (int i = 0; i < 2; i++) {
+        set_and_get(conn, i, outputs[i]);
+    }
+
+    // the SETs are sent while no reply arrived yet
+    auto& stream = conn.connection();
+    REQUIRE(conn.poll() == 0);
+    REQUIRE(stream.flushed_offsets.size() == 1);
+    REQUIRE(conn.pending() == 2);
+
+    // only the coroutine whose reply arrived completely is resumed
+    stream.more_input("+OK\r\n+O");
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(conn.poll() == 0);
+
+    stream.more_input("K\r\n$6\r\nvalue0\r\n$6\r\nval");
+    REQUIRE(conn.poll() == 2);
+    REQUIRE(outputs[0] == "value0");
+    REQUIRE(conn.pending() == 1);
+    REQUIRE(conn.poll() == 0);
+
+    stream.more_input("ue1\r\n");
+    REQUIRE(conn.poll() == 1);
+    REQUIRE(conn.pending() == 0);
+    REQUIRE(outputs[1] == "value1");
+    REQUIRE(stream.flushed_offsets.size() == 3);
+}
+
+TEST_CASE("coroutine_session_closed_stream", "[coroutine_session]")
+{
+    redis::coroutine_session<mock_stream> conn;
+    conn.close();
+
+    std::string output;
+    set_and_get(conn, 0, output);
+
+    // the request completes without suspending
+    REQUIRE(conn.pending() == 0);
+    REQUIRE(output == "SET failed");
+}
+
+} // namespace "redis_test"
+
+#endif // REDIS_HAS_COROUTINES
@@ -0,0 +1,213 @@
+#include "redis_test.h"
+
+#include "fiber.h"
+
+#ifdef REDIS_HAS_FIBERS
+
+#include <string>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <chrono>
+#include <ctime>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+namespace {
+
+// SET and GET of its own keys over a blocking-style session, parked by the stream whenever a reply is not there yet
+void run_client(redis::session<redis::fiber_stream>& conn, int id, int count, int& mismatches)
+{
+    for (int i = 0; i < count; i++) {
+        auto key = "key:" + std::to_string(id) + ":" + std::to_string(i);
+
+        redis::SET<std::string> set;
+        set.key = key;
+        set.value = std::to_string(i);
+
+        redis::GET get;
+        get.key = key;
+
+        if (conn.request(set) || conn.request(get) ||
+            std::string(begin(get.reply.result.data), end(get.reply.result.data)) != std::to_string(i)) {
+            mismatches++;
+        }
+    }
+    conn.close();
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("fiber_scheduler_yield_and_exception", "[fiber]")
+{
+    redis::fiber_scheduler scheduler;
+    std::string order;
+
+    REQUIRE(redis::fiber_scheduler::current() == nullptr);
+    for (char c = 'a'; c < 'd'; c++) {
+        scheduler.spawn([&, c] {
+            REQUIRE(redis::fiber_scheduler::current() == &scheduler);
+            order += c;
+            scheduler.yield();
+            order += static_cast<char>(c - 'a' + 'A');
+        });
+    }
+    REQUIRE(scheduler.size() == 3);
+
+    scheduler.run();
+    REQUIRE(order == "abcABC");
+    REQUIRE(scheduler.size() == 0);
+
+    bool finished = false;
+    scheduler.spawn([] { throw std::runtime_error("failed"); });
+    scheduler.spawn([&] { scheduler.yield(); finished = true; });
+    REQUIRE_THROWS_AS(scheduler.run(), std::runtime_error);
+    REQUIRE(finished);
+}
+
+TEST_CASE("fiber_stream_sessions_share_a_thread", "[fiber]")
+{
+    const int session_count = 200;
+    const int count = 10;
+    int mismatches = 0;
+    int served = 0;
+
+    redis::fiber_scheduler scheduler;
+    std::vector<redis::session<redis::fiber_stream>> clients(session_count);
+    std::vector<redis::fiber_stream> servers(session_count);
+
+    for (int i = 0; i < session_count; i++) {
+        int fds[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        REQUIRE(clients[i].attach(fds[0]));
+        REQUIRE(servers[i].attach(fds[1]));
+
+        scheduler.spawn([&, i] {
+            serve_requests(servers[i]);
+            servers[i].close();
+            served++;
+        });
+        scheduler.spawn([&, i] { run_client(clients[i], i, count, mismatches); });
+    }
+
+    scheduler.run();
+    REQUIRE(mismatches == 0);
+    REQUIRE(served == session_count);
+}
+
+TEST_CASE("fiber_stream_wait_readable", "[fiber]")
+{
+    int fds[2], idle_fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, idle_fds) == 0);
+
+    redis::fiber_stream reader, writer, idle, idle_peer;
+    REQUIRE(reader.attach(fds[0]));
+    REQUIRE(writer.attach(fds[1]));
+    REQUIRE(idle.attach(idle_fds[0]));
+    REQUIRE(idle_peer.attach(idle_fds[1]));
+
+    redis::fiber_scheduler scheduler;
+    bool timed_out = false;
+    bool woken = false;
+    std::chrono::steady_clock::duration waited;
+
+    scheduler.spawn([&] {
+        auto start = std::chrono::steady_clock::now();
+        woken = reader.wait_readable(std::chrono::seconds(10));
+        waited = std::chrono::steady_clock::now() - start;
+    });
+
+    // nothing arrives on the idle socket, so the fiber sleeps until the deadline, then wakes the other one
+    scheduler.spawn([&] {
+        timed_out = !idle.wait_readable(std::chrono::milliseconds(50));
+        writer.write(redis::const_buffer_view("x", 1));
+        writer.flush();
+    });
+
+    auto cpu = std::clock();
+    auto start = std::chrono::steady_clock::now();
+    scheduler.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    cpu = std::clock() - cpu;
+
+    REQUIRE(timed_out);
+    REQUIRE(woken);
+    REQUIRE(elapsed >= std::chrono::milliseconds(50));
+    REQUIRE(waited < std::chrono::seconds(10));
+
+    // the fibers were parked instead of spinning until the deadline
+    REQUIRE(cpu < CLOCKS_PER_SEC / 50);
+}
+
+TEST_CASE("fiber_stream_connect", "[fiber]")
+{
+    auto listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    REQUIRE(listener >= 0);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    REQUIRE(::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    REQUIRE(::listen(listener, 16) == 0);
+    REQUIRE(::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+    auto port = ntohs(address.sin_port);
+
+    const int session_count = 4;
+    int mismatches = 0;
+    int connected = 0;
+    redis::fiber_scheduler scheduler;
+
+    // the acceptor parks on the listening socket and serves every connection on a fiber of its own
+    scheduler.spawn([&] {
+        for (int accepted = 0; accepted < session_count; ) {
+            auto fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                scheduler.wait_fd(listener, EPOLLIN);
+                continue;
+            }
+            accepted++;
+            scheduler.spawn([&, fd] {
+                redis::fiber_stream server;
+                server.attach(fd);
+                serve_requests(server);
+            });
+        }
+    });
+
+    for (int i = 0; i < session_count; i++) {
+        scheduler.spawn([&, i] {
+            redis::session<redis::fiber_stream> conn;
+            if (conn.connect("127.0.0.1", port)) {
+                connected++;
+                run_client(conn, i, 10, mismatches);
+            }
+        });
+    }
+
+    scheduler.run();
+    ::close(listener);
+
+    REQUIRE(connected == session_count);
+    REQUIRE(mismatches == 0);
+}
+
+} // namespace "redis_test"
+
+#endif // REDIS_HAS_FIBERS
@@ -0,0 +1,144 @@
+#include "redis_test.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <iterator>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "ring_stream.h"
+#include "hedged_client.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+namespace {
+
+typedef redis::hedged_client<redis::ring_stream> test_client;
+
+test_client::options test_options()
+{
+    test_client::options opts;
+    opts.connections_per_replica = 1;
+    opts.initial_hedge_delay = std::chrono::milliseconds(20);
+    opts.max_hedge_ratio = 1.0;
+    return opts;
+}
+
+std::string to_string(const redis::bulk_reply& reply)
+{
+    return std::string(begin(reply.result.data), end(reply.result.data));
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("hedged_client_hedges_slow_replica", "[hedged_client]")
+{
+    named_server primary('P'), replica('R');
+    primary.delay_ms = 300;
+    {
+        test_client client({ primary.connector(), replica.connector() }, test_options());
+
+        // the primary does not answer within the hedge delay, so the replica answers instead
+        auto start = std::chrono::steady_clock::now();
+        redis::GET first;
+        first.key = "key";
+        REQUIRE(!client.request(first));
+        REQUIRE(to_string(first.reply) == "R");
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(300));
+
+        // the next read starts on the replica, and needs no hedge
+        redis::GET second;
+        second.key = "key";
+        REQUIRE(!client.request(second));
+        REQUIRE(to_string(second.reply) == "R");
+
+        auto hedging = client.hedging();
+        REQUIRE(hedging.requests == 2);
+        REQUIRE(hedging.hedges == 1);
+        REQUIRE(hedging.hedge_wins == 1);
+        REQUIRE(client.stats(first).requests == 2);
+
+        // writes only go to the primary, which still owes its late reply on the same connection
+        primary.delay_ms = 0;
+        redis::GETSET<std::string> write;
+        write.key = "key";
+        write.value = "value";
+        REQUIRE(!write.is_read_only());
+        REQUIRE(!client.request(write));
+        REQUIRE(std::string(begin(write.reply.result.data), end(write.reply.result.data)) == "P");
+        REQUIRE(client.hedging().hedges == 1);
+    }
+}
+
+TEST_CASE("hedged_client_throttles_hedges", "[hedged_client]")
+{
+    named_server primary('P'), replica('R');
+    primary.delay_ms = 50;
+    {
+        auto opts = test_options();
+        opts.max_hedge_ratio = 0;
+        test_client client({ primary.connector(), replica.connector() }, opts);
+
+        // without hedge credit, the slow reply is waited for
+        redis::GET get;
+        get.key = "key";
+        REQUIRE(!client.request(get));
+        REQUIRE(to_string(get.reply) == "P");
+
+        auto hedging = client.hedging();
+        REQUIRE(hedging.hedges == 0);
+        REQUIRE(hedging.throttled == 1);
+    }
+}
+
+TEST_CASE("hedged_client_request_timeout", "[hedged_client]")
+{
+    named_server primary('P'), replica('R');
+    primary.delay_ms = 200;
+    replica.delay_ms = 200;
+    {
+        auto opts = test_options();
+        opts.request_timeout = std::chrono::milliseconds(50);
+        test_client client({ primary.connector(), replica.connector() }, opts);
+
+        redis::GET get;
+        get.key = "key";
+        REQUIRE(client.request(get) == redis::error::timed_out);
+        REQUIRE(client.hedging().hedges == 1);
+
+        // both connections are kept, and drop their late replies before the next request
+        primary.delay_ms = 0;
+        replica.delay_ms = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+        redis::GET again;
+        again.key = "key";
+        REQUIRE(!client.request(again));
+        REQUIRE(to_string(again.reply) == "R");
+    }
+}
+
+TEST_CASE("hedged_client_no_connection", "[hedged_client]")
+{
+    auto unreachable = [](redis::session<redis::ring_stream>&) { return false; };
+    test_client client({ unreachable, unreachable }, test_options());
+
+    redis::GET read;
+    read.key = "key";
+    REQUIRE(client.request(read) == redis::error::no_connection);
+
+    redis::GETSET<std::string> write;
+    write.key = "key";
+    write.value = "value";
+    REQUIRE(client.request(write) == redis::error::no_connection);
+}
+
+} // namespace "redis_test"
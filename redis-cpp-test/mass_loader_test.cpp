@@ -0,0 +1,156 @@
+#include "redis_test.h"
+
+#include <string>
+#include <thread>
+#include <cstdint>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "ring_stream.h"
+#include "mass_loader.h"
+
+namespace redis_test
+{
+
+TEST_CASE("mass_loader_window", "[mass_loader]")
+{
+    mock_stream stream;
+    std::string expected;
+
+    for (int i = 0; i < 100; i++) {
+        if (i % 10 == 9) {
+            stream.more_input(("-ERR failed " + std::to_string(i) + "\r\n").c_str());
+        } else {
+            stream.more_input("+OK\r\n");
+        }
+        auto key = std::to_string(i);
+        expected += "*3\r\n$3\r\nSET\r\n$" + std::to_string(key.size()) + "\r\n" + key + "\r\n$5\r\nvalue\r\n";
+    }
+
+    redis::mass_loader loader;
+    loader.max_in_flight_commands = 10;
+    loader.max_error_samples = 3;
+
+    int next = 0;
+    redis::load_stats stats;
+    REQUIRE(!loader.load(stream, [&](redis::stream& output) {
+        if (next == 100) {
+            return false;
+        }
+        return !redis::format_command(output, "SET", std::to_string(next++), "value");
+    }, stats));
+
+    REQUIRE(check_equal(expected.c_str(), stream));
+    REQUIRE(stream.available() == 0);
+
+    REQUIRE(stats.commands == 100);
+    REQUIRE(stats.replies == 100);
+    REQUIRE(stats.bytes == expected.size());
+    REQUIRE(stats.max_in_flight == 10);
+    REQUIRE(stream.flushed_offsets.size() == 10);
+
+    REQUIRE(stats.errors == 10);
+    REQUIRE(stats.error_samples.size() == 3);
+    REQUIRE(stats.error_samples[0] == "ERR failed 9");
+    REQUIRE(stats.error_samples[2] == "ERR failed 29");
+}
+
+TEST_CASE("mass_loader_self_flushing_stream", "[mass_loader]")
+{
+    // flushes inside write once more than a few bytes are buffered, as unbuffered or zero-copy writes do
+    struct self_flushing_stream : public mock_stream
+    {
+        virtual bool write(redis::const_buffer_view input) override
+        {
+            mock_stream::write(input);
+            return pending_output() < 16 || flush();
+        }
+    };
+
+    self_flushing_stream stream;
+    std::string expected;
+    for (int i = 0; i < 20; i++) {
+        stream.more_input("+OK\r\n");
+        auto key = std::to_string(i);
+        expected += "*3\r\n$3\r\nSET\r\n$" + std::to_string(key.size()) + "\r\n" + key + "\r\n$5\r\nvalue\r\n";
+    }
+
+    redis::mass_loader loader;
+    loader.max_in_flight_bytes = 200;
+
+    int next = 0;
+    redis::load_stats stats;
+    REQUIRE(!loader.load(stream, [&](redis::stream& output) {
+        return next < 20 && !redis::format_command(output, "SET", std::to_string(next++), "value");
+    }, stats));
+
+    REQUIRE(check_equal(expected.c_str(), stream));
+    REQUIRE(stats.commands == 20);
+    REQUIRE(stats.replies == 20);
+    REQUIRE(stats.bytes == expected.size());
+    REQUIRE(stats.max_in_flight > 1);
+    REQUIRE(stats.max_in_flight < 20); // bounded by the byte limit
+}
+
+TEST_CASE("mass_loader_ill_formed_reply", "[mass_loader]")
+{
+    mock_stream stream;
+    stream.more_input("+OK\r\n?\r\n");
+
+    redis::mass_loader loader;
+    redis::load_stats stats;
+    int next = 0;
+
+    REQUIRE(loader.load(stream, [&](redis::stream& output) {
+        return next++ < 3 && !redis::format_command(output, "PING");
+    }, stats) == redis::error::ill_formed_reply);
+    REQUIRE(stats.commands == 3);
+    REQUIRE(stats.replies == 1);
+}
+
+TEST_CASE("mass_loader_over_ring_stream", "[mass_loader]")
+{
+    auto channel = redis::ring_channel::create(1 << 16);
+    REQUIRE(channel != nullptr);
+
+    const int count = 20000;
+
+    std::thread peer([&] {
+        redis::ring_stream server;
+        if (server.connect(*channel, redis::ring_channel::server_side)) {
+            serve_requests(server, count);
+        }
+        server.close();
+    });
+
+    redis::ring_stream client;
+    REQUIRE(client.connect(*channel));
+
+    // the window stays well below the ring capacity, so neither side blocks on a full ring
+    redis::mass_loader loader;
+    loader.max_in_flight_commands = 256;
+    loader.max_in_flight_bytes = 8192;
+    loader.flush_size = 2048;
+
+    int next = 0;
+    redis::load_stats stats;
+    REQUIRE(!loader.load(client, [&](redis::stream& output) {
+        if (next == count) {
+            return false;
+        }
+        auto key = "key" + std::to_string(next++);
+        return !redis::format_command(output, "SET", key, key);
+    }, stats));
+
+    peer.join();
+
+    REQUIRE(stats.commands == count);
+    REQUIRE(stats.replies == count);
+    REQUIRE(stats.errors == 0);
+    REQUIRE(stats.max_in_flight <= 256);
+    REQUIRE(stats.commands_per_second() > 0);
+}
+
+} // namespace "redis_test"
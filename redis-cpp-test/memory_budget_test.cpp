@@ -0,0 +1,55 @@
+#include "redis_test.h"
+
+#include <thread>
+#include <chrono>
+
+#include <catch.hpp>
+
+#include "memory_budget.h"
+
+namespace redis_test
+{
+
+TEST_CASE("memory_budget_try_acquire", "[memory_budget]")
+{
+    redis::memory_budget budget(1000);
+
+    REQUIRE(budget.try_acquire(600));
+    REQUIRE(!budget.try_acquire(600));
+    REQUIRE(budget.try_acquire(400));
+    REQUIRE(budget.used() == 1000);
+
+    budget.release(500);
+    REQUIRE(budget.used() == 500);
+    REQUIRE(budget.try_acquire(500));
+
+    REQUIRE(budget.rejections() == 1);
+    REQUIRE(budget.waits() == 0);
+}
+
+TEST_CASE("memory_budget_acquire_waits", "[memory_budget]")
+{
+    redis::memory_budget budget(1000);
+    REQUIRE(budget.try_acquire(800));
+
+    // larger than the whole budget, so waiting would never help
+    REQUIRE(!budget.acquire(2000, std::chrono::milliseconds(1000)));
+
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(!budget.acquire(300, std::chrono::milliseconds(10)));
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+
+    std::thread releaser([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        budget.release(500);
+    });
+
+    REQUIRE(budget.acquire(300, std::chrono::milliseconds(10000)));
+    releaser.join();
+
+    REQUIRE(budget.used() == 600);
+    REQUIRE(budget.waits() >= 1);
+    REQUIRE(budget.rejections() == 2);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,115 @@
+#include "redis_test.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <future>
+#include <iterator>
+#include <cstdint>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "ring_stream.h"
+#include "multiplexed_session.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+TEST_CASE("multiplexed_session_shared_by_threads", "[multiplexed_session]")
+{
+    auto channel = redis::ring_channel::create(4096);
+    REQUIRE(channel != nullptr);
+
+    std::thread peer([&] {
+        redis::ring_stream server;
+        if (server.connect(*channel, redis::ring_channel::server_side)) {
+            serve_requests(server);
+        }
+        server.close();
+    });
+
+    redis::multiplexed_session<redis::ring_stream> session;
+    REQUIRE(session.connect(*channel));
+
+    // Catch assertions are not thread-safe, so every client thread only counts its mismatches
+    const int thread_count = 8;
+    const int count = 200;
+    std::vector<int> failures(thread_count, 0);
+    std::vector<std::thread> clients;
+
+    for (int t = 0; t < thread_count; t++) {
+        clients.emplace_back([&, t] {
+            for (int i = 0; i < count; i++) {
+                auto value = std::to_string(t * count + i);
+
+                redis::SET<std::string> set;
+                set.key = "key" + std::to_string(t) + ":" + std::to_string(i);
+                set.value = value;
+
+                redis::GET get;
+                get.key = set.key;
+
+                // both requests are queued before waiting, so they may travel in the same batch
+                auto set_done = session.request(set);
+                auto get_done = session.request(get);
+
+                if (set_done.get() || !set.reply.result || get_done.get() ||
+                    std::string(begin(get.reply.result.data), end(get.reply.result.data)) != value) {
+                    failures[t]++;
+                }
+            }
+        });
+    }
+
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    for (int t = 0; t < thread_count; t++) {
+        REQUIRE(failures[t] == 0);
+    }
+
+    session.close();
+    peer.join();
+
+    REQUIRE(!session.is_open());
+
+    redis::GET get;
+    get.key = "closed";
+    REQUIRE(session.request(get).get() == redis::error::stream_not_initialized);
+}
+
+TEST_CASE("multiplexed_session_fails_queued_requests_when_peer_goes_away", "[multiplexed_session]")
+{
+    auto channel = redis::ring_channel::create(4096);
+    REQUIRE(channel != nullptr);
+
+    std::thread peer([&] {
+        redis::ring_stream server;
+        if (server.connect(*channel, redis::ring_channel::server_side)) {
+            serve_requests(server, 1);
+        }
+        server.close();
+    });
+
+    redis::multiplexed_session<redis::ring_stream> session;
+    REQUIRE(session.connect(*channel));
+
+    redis::GET missing;
+    missing.key = "missing";
+    REQUIRE(!session.request(missing).get());
+    REQUIRE(missing.reply.result.is_null);
+    peer.join();
+
+    // the peer served one request only, so this one hits the end of stream
+    redis::GET get;
+    get.key = "gone";
+    REQUIRE(session.request(get).get() == redis::error::stream_error);
+}
+
+} // namespace "redis_test"
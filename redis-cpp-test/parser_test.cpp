@@ -12,6 +12,7 @@
 
 #include "reply.h"
 #include "writer.h"
+#include "reply_scanner.h"
 #include "redis_test.h"
 
 namespace redis_test
@@ -410,6 +411,61 @@ TEST_CASE("handler_reply", "[parser]")
     }
 }
 
+TEST_CASE("bulk_reply_into_handler_buffer", "[parser]")
+{
+    struct external_buffer_handler : public redis::reply_handler_base
+    {
+        external_buffer_handler() : storage(100), in_place(false) {}
+
+        virtual redis::buffer_view on_bulk_buffer(size_t size) override
+        {
+            return redis::buffer_view(storage.data(), size);
+        }
+
+        virtual bool on_bulk(redis::const_buffer_view data) override
+        {
+            in_place = (data.data() == storage.data());
+            return true;
+        }
+
+        std::vector<char> storage;
+        bool in_place;
+    };
+
+    {
+        mock_stream in;
+        in.more_input("$18\r\nthis is bulk reply\r\n");
+        external_buffer_handler handler;
+        REQUIRE(!redis::parse(in, handler));
+        REQUIRE(handler.in_place);
+        REQUIRE(std::string(handler.storage.data(), 18) == "this is bulk reply");
+        REQUIRE(in.available() == 0);
+    }
+
+    {
+        auto r = make_bulk_reply(1000);
+        mock_stream in;
+        serialize(r.get(), in);
+        redis::bulk_reply handler;
+        REQUIRE(!redis::parse(in, handler));
+        REQUIRE(!handler.result.is_null);
+        REQUIRE(handler.result.data == r->bulk);
+    }
+
+    {
+        mock_stream in;
+        in.more_input("*4\r\n$4\r\ntest\r\n$0\r\n\r\n$-1\r\n$5\r\nreply\r\n");
+        redis::multi_bulk_reply handler;
+        REQUIRE(!redis::parse(in, handler));
+        REQUIRE(handler.result.size() == 4);
+        REQUIRE(std::string(begin(handler.result[0].data), end(handler.result[0].data)) == "test");
+        REQUIRE(!handler.result[1].is_null);
+        REQUIRE(handler.result[1].data.empty());
+        REQUIRE(handler.result[2].is_null);
+        REQUIRE(std::string(begin(handler.result[3].data), end(handler.result[3].data)) == "reply");
+    }
+}
+
 TEST_CASE("ill_formed_reply", "[parser]")
 {
     {
@@ -470,4 +526,40 @@ TEST_CASE("unexpected_end_of_reply", "[parser]")
     }
 }
 
+TEST_CASE("reply_scanner", "[parser]")
+{
+    // result of EVAL "return {'test', 0, {10, {'recursive reply', ''}, false}}" 0, followed by the next reply
+    const std::string first = "*3\r\n$4\r\ntest\r\n:0\r\n*3\r\n:10\r\n*2\r\n$15\r\nrecursive reply\r\n$0\r\n\r\n$-1\r\n";
+    const std::string input = first + "+OK\r\n";
+
+    for (int i = 0; i < 100; i++) {
+        // the reply arrives in random pieces, and only the whole of it is complete
+        redis::reply_scanner scanner;
+        size_t received = 0;
+        auto result = redis::reply_scanner::incomplete;
+
+        while (result == redis::reply_scanner::incomplete) {
+            REQUIRE(received < input.size());
+            received = std::min(input.size(), received + uniform_random<size_t>(1, 8));
+            result = scanner.scan(redis::const_buffer_view(input.data(), received));
+        }
+
+        REQUIRE(result == redis::reply_scanner::complete);
+        REQUIRE(scanner.reply_size() == first.size());
+    }
+
+    {
+        redis::reply_scanner scanner;
+        REQUIRE(scanner.scan(redis::const_buffer_view("*0\r\n", 4)) == redis::reply_scanner::complete);
+        scanner.reset();
+        REQUIRE(scanner.scan(redis::const_buffer_view("*-1\r\n", 5)) == redis::reply_scanner::complete);
+        scanner.reset();
+        REQUIRE(scanner.scan(redis::const_buffer_view("$3\r\nab", 7)) == redis::reply_scanner::incomplete);
+        scanner.reset();
+        REQUIRE(scanner.scan(redis::const_buffer_view("$3a\r\n", 5)) == redis::reply_scanner::ill_formed);
+        scanner.reset();
+        REQUIRE(scanner.scan(redis::const_buffer_view("?\r\n", 3)) == redis::reply_scanner::ill_formed);
+    }
+}
+
 } // namespace "redis_test"
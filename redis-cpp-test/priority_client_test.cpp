@@ -0,0 +1,141 @@
+#include "redis_test.h"
+
+#include <string>
+#include <chrono>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "priority_client.h"
+
+namespace redis_test
+{
+
+namespace {
+
+struct lane_stream : public mock_stream
+{
+    lane_stream()
+    {
+        is_opened = false;
+    }
+};
+
+typedef redis::priority_client<lane_stream> test_client;
+
+bool connect_lane_stream(redis::session<lane_stream>& connection)
+{
+    connection.is_opened = true;
+    for (int i = 0; i < 100; i++) {
+        connection.more_input(":5\r\n");
+    }
+    return true;
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("priority_client_classifies_by_reply_size", "[priority_client]")
+{
+    test_client client(connect_lane_stream);
+
+    redis::GET get;
+    REQUIRE(get.reply_size_hint() == 1);
+    REQUIRE(client.classify(get) == redis::interactive_lane);
+
+    redis::LRANGE head;
+    head.stop = 9;
+    REQUIRE(head.reply_size_hint() == 10);
+    REQUIRE(client.classify(head) == redis::interactive_lane);
+
+    // negative indexes count from the end, so the whole list may be returned
+    redis::LRANGE all;
+    all.stop = -1;
+    REQUIRE(all.reply_size_hint() == redis::unbounded_reply_size);
+    REQUIRE(client.classify(all) == redis::bulk_lane);
+
+    redis::HGETALL hash;
+    REQUIRE(client.classify(hash) == redis::bulk_lane);
+
+    redis::HMGET fields;
+    fields.fields.assign(1001, "field");
+    REQUIRE(fields.reply_size_hint() == 1001);
+    REQUIRE(client.classify(fields) == redis::bulk_lane);
+
+    redis::ZRANGE scored;
+    scored.stop = 599;
+    scored.with_scores = true;
+    REQUIRE(scored.reply_size_hint() == 1200);
+    REQUIRE(client.classify(scored) == redis::bulk_lane);
+
+    redis::ZRANGEBYSCORE limited;
+    limited.use_limit = true;
+    limited.limit_count = 20;
+    REQUIRE(client.classify(limited) == redis::interactive_lane);
+}
+
+TEST_CASE("priority_client_reserves_interactive_lane", "[priority_client]")
+{
+    test_client::options opts;
+    opts.interactive_connections = 1;
+    opts.bulk_connections = 1;
+    opts.wait_timeout = std::chrono::milliseconds(10);
+    test_client client(connect_lane_stream, opts);
+
+    redis::STRLEN cmd;
+    cmd.key = "key";
+    REQUIRE(!client.request(cmd));
+    REQUIRE(cmd.reply.result == 5);
+    REQUIRE(!client.request(cmd, redis::bulk_lane));
+
+    {
+        // every bulk connection is busy with a large reply
+        auto busy = client.pool(redis::bulk_lane).checkout();
+        REQUIRE(busy);
+
+        REQUIRE(client.request(cmd, redis::bulk_lane) == redis::error::no_connection);
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(!client.request(cmd));
+        }
+    }
+
+    auto interactive = client.stats(redis::interactive_lane);
+    REQUIRE(interactive.requests == 11);
+    REQUIRE(interactive.errors == 0);
+    REQUIRE(interactive.max_latency >= interactive.mean_latency());
+    REQUIRE(interactive.percentile(0.99) > std::chrono::microseconds(0));
+    REQUIRE(client.pool(redis::interactive_lane).size() == 1);
+
+    auto bulk = client.stats(redis::bulk_lane);
+    REQUIRE(bulk.requests == 2);
+    REQUIRE(bulk.errors == 1);
+    REQUIRE(bulk.max_latency >= std::chrono::milliseconds(10));
+    REQUIRE(bulk.percentile(1.0) >= std::chrono::milliseconds(10));
+}
+
+TEST_CASE("priority_client_keeps_connection_on_error_reply", "[priority_client]")
+{
+    test_client::options opts;
+    opts.interactive_connections = 1;
+    test_client client([](redis::session<lane_stream>& connection) {
+        connection.is_opened = true;
+        connection.more_input("-WRONGTYPE Operation against a key holding the wrong kind of value\r\n:5\r\n");
+        return true;
+    }, opts);
+
+    redis::STRLEN cmd;
+    cmd.key = "key";
+    REQUIRE(client.request(cmd) == redis::error::error_reply);
+    REQUIRE(!client.request(cmd));
+    REQUIRE(cmd.reply.result == 5);
+
+    auto stats = client.stats(redis::interactive_lane);
+    REQUIRE(stats.requests == 2);
+    REQUIRE(stats.errors == 0);
+
+    auto pool = client.pool(redis::interactive_lane).stats();
+    REQUIRE(pool.created == 1);
+    REQUIRE(pool.reconnects == 0);
+}
+
+} // namespace "redis_test"
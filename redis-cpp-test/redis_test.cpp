@@ -1,5 +1,8 @@
 #include "redis_test.h"
+#include "writer.h"
 
+#include <map>
+#include <chrono>
 #include <string>
 #include <iterator>
 #include <algorithm>
@@ -49,6 +52,79 @@ void serialize(const reply& r, redis::stream& output)
     }
 }
 
+void serve_requests(redis::stream& server, size_t count)
+{
+    std::map<std::vector<char>, std::vector<char>> storage;
+
+    for (size_t served = 0; count == 0 || served < count; served++) {
+        reply_builder request;
+        if (redis::parse(server, request) || !request.root || request.root->multi_bulk.empty()) {
+            return;
+        }
+
+        auto& args = request.root->multi_bulk;
+        std::string name(begin(args[0]->bulk), end(args[0]->bulk));
+
+        if (name == "SET" && args.size() == 3) {
+            storage[args[1]->bulk] = args[2]->bulk;
+            server.write(redis::const_buffer_view("+OK\r\n", 5));
+        } else if (name == "GET" && args.size() == 2) {
+            auto found = storage.find(args[1]->bulk);
+            if (found == storage.end()) {
+                server.write(redis::const_buffer_view("$-1\r\n", 5));
+            } else {
+                redis::detail::write_bulk_element(server, redis::const_buffer_view(found->second.data(), found->second.size()));
+            }
+        } else if (name == "PING") {
+            server.write(redis::const_buffer_view("+PONG\r\n", 7));
+        } else {
+            server.write(redis::const_buffer_view("-ERR unknown command\r\n", 22));
+        }
+
+        if (server.available() == 0 && !server.flush()) {
+            return;
+        }
+    }
+    server.flush();
+}
+
+named_server::named_server(char name) : channel(redis::ring_channel::create(4096)), delay_ms(0)
+{
+    server = std::thread([this, name] {
+        redis::ring_stream stream;
+        if (!stream.connect(*channel, redis::ring_channel::server_side)) {
+            return;
+        }
+        for (;;) {
+            reply_builder request;
+            if (redis::parse(stream, request)) {
+                break; // the client went away
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms.load()));
+
+            const char reply[] = { '$', '1', '\r', '\n', name, '\r', '\n' };
+            stream.write(redis::const_buffer_view(reply, sizeof(reply)));
+            stream.flush();
+        }
+        stream.close();
+    });
+}
+
+named_server::~named_server()
+{
+    // ends the stream even if the client never connected
+    redis::ring_stream hang_up;
+    hang_up.connect(*channel);
+    hang_up.close();
+    server.join();
+}
+
+std::function<bool(redis::session<redis::ring_stream>&)> named_server::connector()
+{
+    auto c = channel.get();
+    return [c](redis::session<redis::ring_stream>& connection) { return connection.connect(*c); };
+}
+
 bool operator== (const reply& lhs, const reply& rhs)
 {
     if (lhs.t != rhs.t) {
@@ -0,0 +1,217 @@
+#include "redis_test.h"
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <iterator>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "ring_stream.h"
+#include "replica_client.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+namespace {
+
+typedef redis::replica_client<redis::ring_stream> test_client;
+
+test_client::options test_options(test_client::balance_policy policy)
+{
+    test_client::options opts;
+    opts.policy = policy;
+    opts.connections_per_endpoint = 1;
+    return opts;
+}
+
+std::string to_string(const redis::bulk_reply& reply)
+{
+    return std::string(begin(reply.result.data), end(reply.result.data));
+}
+
+} // the end of anonymous namespace
+
+TEST_CASE("replica_client_least_outstanding", "[replica_client]")
+{
+    named_server primary('P'), slow('A'), fast('B');
+    slow.delay_ms = 200;
+    {
+        test_client client(primary.connector(), { slow.connector(), fast.connector() }, test_options(test_client::least_outstanding));
+        REQUIRE(client.endpoint_count() == 3);
+
+        // with nothing in flight, the first read goes to the first replica
+        redis::GET pending;
+        pending.key = "key";
+        std::thread reader([&] {
+            REQUIRE(!client.request(pending));
+        });
+        while (client.stats(1).outstanding == 0) {
+            std::this_thread::yield();
+        }
+
+        // while it waits, reads go to the other replica
+        redis::GET get;
+        get.key = "key";
+        REQUIRE(client.route(get) == 2);
+        REQUIRE(!client.request(get));
+        REQUIRE(to_string(get.reply) == "B");
+
+        reader.join();
+        REQUIRE(to_string(pending.reply) == "A");
+
+        auto stats = client.stats(1);
+        REQUIRE(stats.requests == 1);
+        REQUIRE(stats.errors == 0);
+        REQUIRE(stats.outstanding == 0);
+        REQUIRE(stats.latency_ewma >= std::chrono::milliseconds(200));
+    }
+}
+
+TEST_CASE("replica_client_latency_p2c", "[replica_client]")
+{
+    named_server primary('P'), slow('A'), fast('B');
+    slow.delay_ms = 30;
+    {
+        test_client client(primary.connector(), { slow.connector(), fast.connector() }, test_options(test_client::latency_p2c));
+
+        // a replica without requests has no latency yet, so both get tried within the first two reads
+        for (int i = 0; i < 4; i++) {
+            redis::GET get;
+            get.key = "key";
+            REQUIRE(!client.request(get));
+        }
+        REQUIRE(client.stats(1).requests >= 1);
+        REQUIRE(client.stats(2).requests >= 1);
+        REQUIRE(client.stats(1).latency_ewma > client.stats(2).latency_ewma);
+
+        redis::GET get;
+        get.key = "key";
+        REQUIRE(client.route(get) == 2);
+        REQUIRE(!client.request(get));
+        REQUIRE(to_string(get.reply) == "B");
+    }
+}
+
+TEST_CASE("replica_client_latency_p2c_recovery", "[replica_client]")
+{
+    named_server primary('P'), slow('A'), fast('B');
+    slow.delay_ms = 30;
+    {
+        auto opts = test_options(test_client::latency_p2c);
+        opts.ewma_decay = std::chrono::milliseconds(5);
+        test_client client(primary.connector(), { slow.connector(), fast.connector() }, opts);
+
+        for (int i = 0; i < 4; i++) {
+            redis::GET get;
+            get.key = "key";
+            REQUIRE(!client.request(get));
+        }
+        REQUIRE(client.stats(1).requests >= 1);
+        auto slow_requests = client.stats(1).requests;
+
+        // the replica recovered, and its stale EWMA fades until it gets a read again
+        slow.delay_ms = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (client.stats(1).requests == slow_requests && std::chrono::steady_clock::now() < deadline) {
+            redis::GET get;
+            get.key = "key";
+            REQUIRE(!client.request(get));
+        }
+        REQUIRE(client.stats(1).requests > slow_requests);
+        REQUIRE(client.stats(1).latency_ewma < std::chrono::milliseconds(30));
+    }
+}
+
+TEST_CASE("replica_client_fallback_to_primary", "[replica_client]")
+{
+    named_server primary('P');
+    {
+        auto opts = test_options(test_client::least_outstanding);
+        opts.wait_timeout = std::chrono::milliseconds(10);
+        test_client client(primary.connector(), { [](redis::session<redis::ring_stream>&) { return false; } }, opts);
+
+        redis::GET read;
+        read.key = "key";
+        REQUIRE(client.route(read) == 1);
+        REQUIRE(!client.request(read));
+        REQUIRE(to_string(read.reply) == "P");
+
+        // the primary served it
+        REQUIRE(client.stats(test_client::primary_endpoint).requests == 1);
+        REQUIRE(client.stats(1).requests == 0);
+        REQUIRE(client.stats(1).outstanding == 0);
+        REQUIRE(client.pool(1).stats().failures == 1);
+    }
+
+    {
+        // neither endpoint gives a connection
+        auto unreachable = [](redis::session<redis::ring_stream>&) { return false; };
+        auto opts = test_options(test_client::least_outstanding);
+        opts.wait_timeout = std::chrono::milliseconds(10);
+        test_client client(unreachable, { unreachable }, opts);
+
+        redis::GET read;
+        read.key = "key";
+        REQUIRE(client.request(read) == redis::error::no_connection);
+        REQUIRE(client.stats(test_client::primary_endpoint).errors == 1);
+    }
+}
+
+TEST_CASE("replica_client_writes_to_primary", "[replica_client]")
+{
+    named_server primary('P'), replica('R');
+    {
+        test_client client(primary.connector(), { replica.connector() }, test_options(test_client::least_outstanding));
+
+        redis::GETSET<std::string> write;
+        write.key = "key";
+        write.value = "value";
+        REQUIRE(client.route(write) == test_client::primary_endpoint);
+        REQUIRE(!client.request(write));
+        REQUIRE(to_string(write.reply) == "P");
+
+        redis::GET read;
+        read.key = "key";
+        REQUIRE(!client.request(read));
+        REQUIRE(to_string(read.reply) == "R");
+
+        REQUIRE(client.stats(test_client::primary_endpoint).requests == 1);
+        REQUIRE(client.stats(1).requests == 1);
+    }
+}
+
+TEST_CASE("replica_client_keeps_connection_on_error_reply", "[replica_client]")
+{
+    typedef redis::replica_client<mock_stream> mock_client;
+
+    mock_client::options opts;
+    opts.connections_per_endpoint = 1;
+    mock_client client([](redis::session<mock_stream>&) { return true; }, {
+        [](redis::session<mock_stream>& connection) {
+            connection.more_input("-WRONGTYPE Operation against a key holding the wrong kind of value\r\n$1\r\nR\r\n");
+            return true;
+        },
+    }, opts);
+
+    redis::GET get;
+    get.key = "key";
+    REQUIRE(client.request(get) == redis::error::error_reply);
+    REQUIRE(!client.request(get));
+    REQUIRE(to_string(get.reply) == "R");
+
+    auto stats = client.stats(1);
+    REQUIRE(stats.requests == 2);
+    REQUIRE(stats.errors == 0);
+
+    auto pool = client.pool(1).stats();
+    REQUIRE(pool.created == 1);
+    REQUIRE(pool.reconnects == 0);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,57 @@
+#include "redis_test.h"
+
+#include <catch.hpp>
+
+#include "reply_size_histogram.h"
+
+namespace redis_test
+{
+
+TEST_CASE("reply_size_histogram_percentile", "[reply_size_histogram]")
+{
+    redis::reply_size_histogram histogram;
+    REQUIRE(histogram.samples() == 0);
+    REQUIRE(histogram.percentile(0.9) == 0);
+
+    for (int i = 0; i < 90; i++) {
+        histogram.record(100);
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.record(100000);
+    }
+
+    REQUIRE(histogram.samples() == 100);
+    REQUIRE(histogram.percentile(0.5) == 128);
+    REQUIRE(histogram.percentile(0.9) == 128);
+    REQUIRE(histogram.percentile(0.95) == 131072);
+    REQUIRE(histogram.percentile(1.0) == 131072);
+
+    // a power of two needs the next bucket
+    redis::reply_size_histogram exact;
+    exact.record(4096);
+    REQUIRE(exact.percentile(1.0) == 8192);
+
+    histogram.clear();
+    REQUIRE(histogram.samples() == 0);
+    REQUIRE(histogram.percentile(0.9) == 0);
+}
+
+TEST_CASE("reply_size_histogram_decay", "[reply_size_histogram]")
+{
+    redis::reply_size_histogram histogram(16);
+
+    for (int i = 0; i < 16; i++) {
+        histogram.record(1000000);
+    }
+    REQUIRE(histogram.samples() == 8);
+    REQUIRE(histogram.percentile(0.5) == 1048576);
+
+    // the large replies fade out once the workload changes
+    for (int i = 0; i < 64; i++) {
+        histogram.record(200);
+    }
+    REQUIRE(histogram.samples() < 32);
+    REQUIRE(histogram.percentile(1.0) == 256);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,199 @@
+#include "redis_test.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "spsc_ring.h"
+#include "ring_stream.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+TEST_CASE("spsc_ring_wrap_around", "[ring_stream]")
+{
+    const size_t capacity = 16;
+    std::vector<char> memory(redis::spsc_ring::required_size(capacity) + 64);
+    auto aligned = memory.data() + (64 - reinterpret_cast<uintptr_t>(memory.data()) % 64) % 64;
+
+    redis::spsc_ring producer, consumer;
+    producer.attach(aligned, capacity, true);
+    consumer.attach(aligned, capacity, false);
+
+    // the pattern repeats every 26 bytes, so any window of it continues the stream written so far
+    const char data[] = "abcdefghijklmnopqrstuvwxyzabcdefghij";
+    std::string received;
+    size_t written = 0;
+
+    for (int i = 0; i < 100; i++) {
+        auto size = uniform_random<size_t>(0, 10);
+        auto offset = written % 26;
+        written += producer.write_some(redis::const_buffer_view(data + offset, size));
+        REQUIRE(consumer.readable() <= capacity);
+
+        char buffer[7];
+        auto result = consumer.read_some(redis::buffer_view(buffer, uniform_random<size_t>(0, sizeof(buffer))));
+        received.append(buffer, result);
+    }
+
+    char buffer[capacity];
+    received.append(buffer, consumer.read_some(redis::buffer_view(buffer, sizeof(buffer))));
+    REQUIRE(received.size() == written);
+
+    std::string expected;
+    for (size_t i = 0; i < written; i++) {
+        expected.push_back(data[i % 26]);
+    }
+    REQUIRE(received == expected);
+
+    producer.close();
+    REQUIRE(consumer.is_closed());
+    REQUIRE(!producer.is_reader_closed());
+
+    consumer.close_reader();
+    REQUIRE(producer.is_reader_closed());
+}
+
+TEST_CASE("ring_stream_request", "[ring_stream]")
+{
+    auto channel = redis::ring_channel::create(64); // small ring to exercise wrap around
+    REQUIRE(channel != nullptr);
+
+    const int count = 1000;
+
+    std::thread peer([&] {
+        redis::ring_stream server;
+        if (server.connect(*channel, redis::ring_channel::server_side)) {
+            serve_requests(server, count * 2);
+        }
+        server.close();
+    });
+
+    redis::session<redis::ring_stream> session;
+    REQUIRE(session.connect(*channel));
+
+    for (int i = 0; i < count; i++) {
+        redis::SET<int32_t> set;
+        set.key = "key" + std::to_string(i);
+        set.value = i;
+        REQUIRE(!session.request(set));
+        REQUIRE(set.reply.result);
+
+        redis::GET get;
+        get.key = set.key;
+        REQUIRE(!session.request(get));
+        REQUIRE(std::string(begin(get.reply.result.data), end(get.reply.result.data)) == std::to_string(i));
+    }
+
+    peer.join();
+
+    // the peer closed its side, so reading hits the end of stream
+    redis::GET get;
+    get.key = "closed";
+    REQUIRE(session.request(get) == redis::error::stream_error);
+}
+
+TEST_CASE("ring_stream_request_deadline", "[ring_stream]")
+{
+    auto channel = redis::ring_channel::create(4096);
+    REQUIRE(channel != nullptr);
+
+    std::thread peer([&] {
+        redis::ring_stream server;
+        if (server.connect(*channel, redis::ring_channel::server_side)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200)); // a slow server
+            serve_requests(server, 3);
+        }
+        server.close();
+    });
+
+    redis::session<redis::ring_stream> session;
+    REQUIRE(session.connect(*channel));
+
+    auto start = std::chrono::steady_clock::now();
+    redis::GET slow;
+    slow.key = "key";
+    REQUIRE(session.request_for(slow, std::chrono::milliseconds(20)) == redis::error::timed_out);
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200));
+    REQUIRE(session.is_open());
+    REQUIRE(session.late_replies() == 1);
+
+    // the same connection serves the next requests once the late reply is skipped
+    redis::SET<std::string> set;
+    set.key = "key";
+    set.value = "value";
+    REQUIRE(!session.request(set));
+    REQUIRE(set.reply.result);
+    REQUIRE(session.late_replies() == 0);
+
+    redis::GET get;
+    get.key = "key";
+    REQUIRE(!session.request_for(get, std::chrono::seconds(10)));
+    REQUIRE(std::string(begin(get.reply.result.data), end(get.reply.result.data)) == "value");
+
+    peer.join();
+}
+
+TEST_CASE("ring_stream_flush_to_gone_peer", "[ring_stream]")
+{
+    auto channel = redis::ring_channel::create(4096);
+    REQUIRE(channel != nullptr);
+
+    redis::ring_stream client, server;
+    REQUIRE(client.connect(*channel));
+    REQUIRE(server.connect(*channel, redis::ring_channel::server_side));
+
+    // more than the ring holds, so that the flush needs the peer to read
+    std::vector<char> data(16384, 'x');
+    REQUIRE(client.write(redis::const_buffer_view(data.data(), data.size())));
+
+    SECTION("closed peer") {
+        REQUIRE(server.close());
+        REQUIRE(!client.flush());
+    }
+
+    SECTION("dead peer") {
+        client.set_flush_timeout(std::chrono::milliseconds(50));
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(!client.flush());
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+        REQUIRE(server.is_open());
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("ring_channel_shared_memory", "[ring_stream]")
+{
+    auto name = "/redis-cpp-test-" + std::to_string(uniform_random<uint32_t>());
+    auto owner = redis::ring_channel::create_shared(name, 4096);
+    REQUIRE(owner != nullptr);
+    REQUIRE(redis::ring_channel::create_shared(name) == nullptr); // already exists
+
+    auto peer = redis::ring_channel::open_shared(name);
+    REQUIRE(peer != nullptr);
+
+    redis::ring_stream client, server;
+    REQUIRE(client.connect(*owner));
+    REQUIRE(server.connect(*peer, redis::ring_channel::server_side));
+
+    REQUIRE(!redis::format_command(client, "PING"));
+    REQUIRE(client.flush());
+
+    reply_builder request;
+    REQUIRE(!redis::parse(server, request));
+    REQUIRE(request.root->multi_bulk.size() == 1);
+    REQUIRE(request.root->multi_bulk[0]->bulk == std::vector<char>({ 'P', 'I', 'N', 'G' }));
+}
+#endif
+
+} // namespace "redis_test"
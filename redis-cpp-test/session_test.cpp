@@ -0,0 +1,209 @@
+#include "redis_test.h"
+
+#include <vector>
+#include <string>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+std::string to_string(const redis::bulk_data& data)
+{
+    return std::string(begin(data.data), end(data.data));
+}
+
+TEST_CASE("pipeline", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input("+OK\r\n$5\r\nvalue\r\n:1\r\n");
+
+    redis::SET<std::string> set;
+    set.key = "key";
+    set.value = "value";
+    redis::GET get;
+    get.key = "key";
+    redis::DEL del;
+    del.key = "key";
+
+    redis::command_pipeline batch;
+    batch.add(set).add(get).add(del);
+
+    REQUIRE(!session.pipeline(batch));
+    REQUIRE(check_equal(
+        "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n"
+        "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n"
+        "*2\r\n$3\r\nDEL\r\n$3\r\nkey\r\n", session));
+    REQUIRE(session.flushed_offsets.size() == 1);
+
+    REQUIRE(set.reply.result);
+    REQUIRE(to_string(get.reply.result) == "value");
+    REQUIRE(del.reply.result == 1);
+    for (size_t i = 0; i < batch.size(); i++) {
+        REQUIRE(!batch.result(i));
+    }
+}
+
+TEST_CASE("pipeline_error_reply", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input(":3\r\n-WRONGTYPE Operation against a key holding the wrong kind of value\r\n:2\r\n");
+
+    redis::STRLEN first, second, third;
+    first.key = "a";
+    second.key = "b";
+    third.key = "c";
+
+    redis::command_pipeline batch;
+    batch.add(first).add(second).add(third);
+
+    REQUIRE(session.pipeline(batch) == redis::error::error_reply);
+    REQUIRE(session.is_open()); // error replies do not break the stream
+    REQUIRE(!batch.result(0));
+    REQUIRE(batch.result(1) == redis::error::error_reply);
+    REQUIRE(!batch.result(2));
+    REQUIRE(first.reply.result == 3);
+    REQUIRE(second.reply.error_info.find("WRONGTYPE") == 0);
+    REQUIRE(third.reply.result == 2);
+}
+
+TEST_CASE("pipeline_intermediate_flush", "[session]")
+{
+    redis::session<mock_stream> session;
+
+    std::vector<redis::GET> commands(10);
+    redis::command_pipeline batch;
+    batch.max_buffered = 40; // each command takes 24 bytes - flush every two commands
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        commands[i].key = "key" + std::to_string(i);
+        session.more_input(("$6\r\nvalue" + std::to_string(i) + "\r\n").c_str());
+        batch.add(commands[i]);
+    }
+
+    REQUIRE(!session.pipeline(batch));
+    REQUIRE(session.flushed_offsets.size() == 5);
+    for (size_t i = 0; i < commands.size(); i++) {
+        REQUIRE(to_string(commands[i].reply.result) == "value" + std::to_string(i));
+    }
+}
+
+TEST_CASE("pipeline_stream_error", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input(":1\r\n:2"); // the second reply is cut
+
+    redis::STRLEN first, second, third;
+    redis::command_pipeline batch;
+    batch.add(first).add(second).add(third);
+
+    REQUIRE(session.pipeline(batch) == redis::error::stream_error);
+    REQUIRE(!session.is_open());
+    REQUIRE(!batch.result(0));
+    REQUIRE(first.reply.result == 1);
+    REQUIRE(batch.result(1) == redis::error::stream_error);
+    REQUIRE(batch.result(2) == redis::error::stream_error);
+}
+
+TEST_CASE("typed_pipeline", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input("$5\r\nvalue\r\n-ERR not an integer\r\n*2\r\n$5\r\nfield\r\n$5\r\nvalue\r\n");
+
+    redis::GET get;
+    get.key = "key";
+    redis::STRLEN strlen;
+    strlen.key = "key";
+    redis::HGETALL hgetall;
+    hgetall.key = "hash";
+
+    auto result = session.pipeline(get, strlen, std::move(hgetall));
+    REQUIRE(session.flushed_offsets.size() == 1);
+    REQUIRE(result.error == redis::error::error_reply);
+    REQUIRE(!result.results[0]);
+    REQUIRE(result.results[1] == redis::error::error_reply);
+    REQUIRE(!result.results[2]);
+
+    REQUIRE(to_string(std::get<0>(result.replies).result) == "value");
+    REQUIRE(to_string(get.reply.result) == "value"); // lvalue commands keep their replies
+    REQUIRE(std::get<1>(result.replies).error_info == "ERR not an integer");
+    REQUIRE(std::get<2>(result.replies).result.size() == 2);
+    REQUIRE(to_string(std::get<2>(result.replies).result[0]) == "field");
+}
+
+TEST_CASE("typed_pipeline_stream_error", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input("$5\r\nval");
+
+    redis::GET first, second;
+    auto result = session.pipeline(first, second);
+    REQUIRE(result.error == redis::error::stream_error);
+    REQUIRE(result.results[0] == redis::error::stream_error);
+    REQUIRE(result.results[1] == redis::error::stream_error);
+    REQUIRE(!session.is_open());
+}
+
+TEST_CASE("request_deadline", "[session]")
+{
+    redis::session<mock_stream> session;
+    session.more_input("$5\r\nval"); // the reply has not fully arrived
+
+    redis::GET first;
+    first.key = "first";
+    REQUIRE(session.request_for(first, std::chrono::milliseconds(10)) == redis::error::timed_out);
+    REQUIRE(session.is_open());
+    REQUIRE(session.late_replies() == 1);
+    REQUIRE(session.available() == 7); // nothing consumed
+
+    // the late reply is dropped before the reply of the next request is parsed
+    session.more_input("ue\r\n$6\r\nsecond\r\n");
+    redis::GET second;
+    second.key = "second";
+    REQUIRE(!session.request_for(second, std::chrono::milliseconds(10)));
+    REQUIRE(to_string(second.reply.result) == "second");
+    REQUIRE(session.late_replies() == 0);
+
+    // an error reply keeps the connection as well
+    session.more_input("-ERR wrong\r\n");
+    redis::GET third;
+    REQUIRE(session.request_for(third, std::chrono::milliseconds(10)) == redis::error::error_reply);
+    REQUIRE(session.is_open());
+
+    // with no request sent, there is no reply to receive
+    REQUIRE(session.receive_reply(third.reply, std::chrono::steady_clock::now()) == redis::error::no_pending_request);
+    REQUIRE(session.is_open());
+}
+
+TEST_CASE("request_deadline_blocking_request", "[session]")
+{
+    redis::session<mock_stream> session;
+
+    redis::GET first;
+    REQUIRE(session.request_for(first, std::chrono::milliseconds(0)) == redis::error::timed_out);
+    REQUIRE(session.late_replies() == 1);
+
+    session.more_input("*2\r\n$1\r\na\r\n$1\r\nb\r\n:7\r\n");
+    redis::DEL del;
+    del.key = "key";
+    REQUIRE(!session.request(del));
+    REQUIRE(del.reply.result == 7);
+    REQUIRE(session.late_replies() == 0);
+
+    // closing forgets the replies still to arrive
+    redis::GET second;
+    REQUIRE(session.request_for(second, std::chrono::milliseconds(0)) == redis::error::timed_out);
+    session.close();
+    REQUIRE(session.late_replies() == 0);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,171 @@
+#include "redis_test.h"
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <iterator>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "command.h"
+#include "spsc_queue.h"
+#include "ring_stream.h"
+#include "sharded_client.h"
+
+namespace redis_test
+{
+
+using std::begin;
+using std::end;
+
+TEST_CASE("spsc_queue_across_threads", "[sharded_client]")
+{
+    redis::spsc_queue<int> queue(8);
+    const int count = 100000;
+
+    std::thread producer([&] {
+        for (int i = 0; i < count; i++) {
+            int value = i;
+            while (!queue.push(std::move(value))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    bool in_order = true;
+    while (expected < count) {
+        int value;
+        if (queue.pop(value)) {
+            in_order = in_order && value == expected;
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    REQUIRE(in_order);
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE("sharded_client_tasks_stay_on_their_shard", "[sharded_client]")
+{
+    const size_t shard_count = 4;
+
+    std::vector<std::unique_ptr<redis::ring_channel>> channels;
+    std::vector<std::thread> peers;
+    for (size_t i = 0; i < shard_count; i++) {
+        channels.push_back(redis::ring_channel::create(1 << 16));
+        auto channel = channels.back().get();
+        peers.emplace_back([channel] {
+            redis::ring_stream server;
+            if (server.connect(*channel, redis::ring_channel::server_side)) {
+                serve_requests(server);
+            }
+            server.close();
+        });
+    }
+
+    redis::sharded_client<redis::ring_stream>::options opts;
+    opts.shard_count = shard_count;
+    opts.pin_threads = false;
+
+    redis::sharded_client<redis::ring_stream> client;
+    REQUIRE(client.start([&](redis::session<redis::ring_stream>& connection, size_t shard_index) {
+        return connection.connect(*channels[shard_index]);
+    }, opts));
+    REQUIRE(client.shard_count() == shard_count);
+
+    // every key is written and read back on its own shard, then the shard hands a task to the next one
+    const int count = 1000;
+    std::atomic<int> succeeded(0), forwarded(0), misplaced(0);
+
+    for (int i = 0; i < count; i++) {
+        auto key = "key" + std::to_string(i);
+        auto owner = redis::shard_for_key(redis::const_buffer_view(key.data(), key.size()), shard_count);
+
+        REQUIRE(client.submit_for_key(redis::const_buffer_view(key.data(), key.size()), [=, &succeeded, &forwarded, &misplaced](redis::sharded_client<redis::ring_stream>::shard& s) {
+            if (s.index() != owner) {
+                misplaced++;
+            }
+
+            redis::SET<std::string> set;
+            set.key = key;
+            set.value = key;
+            redis::GET get;
+            get.key = key;
+            if (!s.connection().request(set) && !s.connection().request(get) &&
+                std::string(begin(get.reply.result.data), end(get.reply.result.data)) == key) {
+                succeeded++;
+            }
+
+            auto next = (s.index() + 1) % shard_count;
+            s.submit(next, [next, &forwarded, &misplaced](redis::sharded_client<redis::ring_stream>::shard& target) {
+                if (target.index() != next) {
+                    misplaced++;
+                }
+                forwarded++;
+            });
+        }));
+    }
+
+    // a shard which already stopped drops what other shards submit to it, so wait for the forwarded tasks first
+    for (int i = 0; i < 10000 && forwarded < count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    client.stop();
+    for (auto& peer : peers) {
+        peer.join();
+    }
+
+    REQUIRE(misplaced == 0);
+    REQUIRE(succeeded == count);
+    REQUIRE(forwarded == count);
+}
+
+TEST_CASE("sharded_client_submit_while_stopping", "[sharded_client]")
+{
+    typedef redis::sharded_client<redis::ring_stream> client_type;
+
+    client_type::options opts;
+    opts.shard_count = 2;
+    opts.connections_per_shard = 0;
+    opts.pin_threads = false;
+
+    client_type client;
+    REQUIRE(client.start([](redis::session<redis::ring_stream>&, size_t) { return true; }, opts));
+
+    // submits race with stop, and every task accepted before it still runs
+    std::atomic<bool> submitting(true);
+    std::atomic<int> accepted(0), ran(0);
+    std::vector<std::thread> submitters;
+    for (size_t i = 0; i < 4; i++) {
+        submitters.emplace_back([&, i] {
+            while (submitting) {
+                if (client.submit(i % opts.shard_count, [&ran](client_type::shard&) { ran++; })) {
+                    accepted++;
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    client.stop();
+    REQUIRE(!client.submit(0, [](client_type::shard&) {}));
+
+    submitting = false;
+    for (auto& t : submitters) {
+        t.join();
+    }
+
+    REQUIRE(accepted > 0);
+    REQUIRE(ran == accepted);
+}
+
+} // namespace "redis_test"
@@ -0,0 +1,177 @@
+#include "redis_test.h"
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include <catch.hpp>
+
+#include "redis_base.h"
+#include "work_stealing_executor.h"
+
+namespace redis_test
+{
+
+namespace {
+
+void wait_for(const std::atomic<int>& counter, int expected)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (counter.load() < expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// reports at most 'chunk' bytes as buffered, and none with a zero chunk, so that a reply is framed in several rounds
+struct trickle_stream : public mock_stream
+{
+    explicit trickle_stream(size_t chunk) : chunk(chunk) {}
+
+    virtual size_t available() const override
+    {
+        return std::min(mock_stream::available(), chunk);
+    }
+
+    size_t chunk;
+};
+
+} // the end of anonymous namespace
+
+TEST_CASE("work_stealing_executor_runs_tasks", "[work_stealing_executor]")
+{
+    const int outer = 200;
+    const int inner = 10;
+    std::atomic<int> counter(0);
+
+    {
+        redis::work_stealing_executor executor(4);
+        REQUIRE(executor.thread_count() == 4);
+
+        // tasks submitted by a worker go to its own queue, from which the idle workers steal
+        for (int i = 0; i < outer; i++) {
+            executor.submit([&] {
+                for (int j = 0; j < inner; j++) {
+                    executor.submit([&] { counter++; });
+                }
+                counter++;
+            });
+        }
+
+        wait_for(counter, outer * (inner + 1));
+        REQUIRE(counter == outer * (inner + 1));
+
+        // the destructor runs what is still queued
+        for (int i = 0; i < outer; i++) {
+            executor.submit([&] { counter++; });
+        }
+    }
+    REQUIRE(counter == outer * (inner + 2));
+
+    redis::work_stealing_executor single(0);
+    REQUIRE(single.thread_count() == 1);
+}
+
+TEST_CASE("work_stealing_executor_dispatch_reply", "[work_stealing_executor]")
+{
+    std::string input = "*1000\r\n";
+    for (int i = 0; i < 1000; i++) {
+        switch (i % 5) {
+        case 0: {
+            auto size = (i % 3 == 0) ? 5000 : i;
+            input += "$" + std::to_string(size) + "\r\n" + std::string(size, 'a' + i % 26) + "\r\n";
+            break;
+        }
+        case 1:
+            input += ":" + std::to_string(-i) + "\r\n";
+            break;
+        case 2:
+            input += "$-1\r\n";
+            break;
+        case 3:
+            input += "*2\r\n+nested\r\n$0\r\n\r\n";
+            break;
+        default:
+            input += "+field\r\n";
+            break;
+        }
+    }
+    input += "-ERR busy\r\n+OK\r\n";
+
+    mock_stream conn;
+    conn.more_input(input.c_str());
+
+    redis::work_stealing_executor executor(2);
+    auto multi_bulk = std::make_shared<reply_builder>();
+    auto error = std::make_shared<reply_builder>();
+    auto status = std::make_shared<reply_builder>();
+
+    std::atomic<int> completed(0);
+    std::error_code results[3];
+    auto on_done = [&](int index) {
+        return [&, index](std::error_code ec) {
+            results[index] = ec;
+            completed++;
+        };
+    };
+
+    // the I/O thread only frames the replies, the handlers run on the workers
+    REQUIRE(!redis::dispatch_reply(conn, executor, multi_bulk, on_done(0)));
+    REQUIRE(!redis::dispatch_reply(conn, executor, error, on_done(1)));
+    REQUIRE(!redis::dispatch_reply(conn, executor, status, on_done(2)));
+    REQUIRE(conn.available() == 0);
+
+    // an incomplete reply is reported on the calling thread
+    REQUIRE(redis::dispatch_reply(conn, executor, std::make_shared<reply_builder>()));
+
+    wait_for(completed, 3);
+    REQUIRE(completed == 3);
+    REQUIRE(!results[0]);
+    REQUIRE(results[1] == redis::error::error_reply);
+    REQUIRE(!results[2]);
+
+    mock_stream direct;
+    direct.more_input(input.c_str());
+    reply_builder expected[3];
+    for (auto& b : expected) {
+        redis::parse(direct, b);
+    }
+    REQUIRE(*expected[0].root == *multi_bulk->root);
+    REQUIRE(*expected[1].root == *error->root);
+    REQUIRE(*expected[2].root == *status->root);
+}
+
+TEST_CASE("work_stealing_executor_dispatch_reply_in_pieces", "[work_stealing_executor]")
+{
+    auto input = "*3\r\n$5000\r\n" + std::string(5000, 'x') + "\r\n:42\r\n*2\r\n+nested\r\n$-1\r\n-ERR busy\r\n+OK\r\n";
+
+    mock_stream direct;
+    direct.more_input(input.c_str());
+    reply_builder expected[3];
+    for (auto& b : expected) {
+        redis::parse(direct, b);
+    }
+
+    redis::work_stealing_executor executor(2);
+    for (size_t chunk : { 0, 1, 7, 4096 }) {
+        trickle_stream conn(chunk);
+        conn.more_input(input.c_str());
+
+        std::shared_ptr<reply_builder> replies[3];
+        std::atomic<int> completed(0);
+        for (auto& reply : replies) {
+            reply = std::make_shared<reply_builder>();
+            REQUIRE(!redis::dispatch_reply(conn, executor, reply, [&completed](std::error_code) { completed++; }));
+        }
+        REQUIRE(conn.mock_stream::available() == 0);
+
+        wait_for(completed, 3);
+        for (size_t i = 0; i < 3; i++) {
+            REQUIRE(*expected[i].root == *replies[i]->root);
+        }
+    }
+}
+
+} // namespace "redis_test"
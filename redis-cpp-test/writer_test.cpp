@@ -190,6 +190,36 @@ TEST_CASE("write_element_for_each_type", "[writer]")
     }
 }
 
+TEST_CASE("write_file_region", "[writer]")
+{
+    auto file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    const char content[] = "header|this is file content|trailer";
+    REQUIRE(std::fwrite(content, 1, sizeof(content) - 1, file) == sizeof(content) - 1);
+    std::fflush(file);
+
+    {
+        redis::file_region region = { fileno(file), 7, 20 };
+        write_element_test(region, "$20\r\nthis is file content\r\n");
+    }
+
+    {
+        mock_stream output;
+        redis::file_region region = { fileno(file), 0, 6 };
+        REQUIRE(!redis::format_command(output, "SET", "key", region));
+        REQUIRE(check_equal("*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$6\r\nheader\r\n", output));
+    }
+
+    {
+        // region beyond the end of file
+        mock_stream output;
+        redis::file_region region = { fileno(file), 30, 100 };
+        REQUIRE(!redis::write_element(output, region));
+    }
+
+    std::fclose(file);
+}
+
 TEST_CASE("write_variadic_element", "[writer]")
 {
     {
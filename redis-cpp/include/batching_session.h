@@ -0,0 +1,260 @@
+#ifndef REDIS_BATCHING_SESSION_H
+#define REDIS_BATCHING_SESSION_H
+
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <utility>
+#include <system_error>
+
+#include "redis_base.h"
+#include "reply_scanner.h"
+
+namespace redis
+{
+
+// session with application-level Nagle batching
+// send writes the command into the stream buffer and returns a future at once - written commands are flushed together
+// once 'max_batch_commands' or 'max_batch_bytes' is reached, once the oldest one waited for 'linger' (checked by send and
+// poll), or when a future of an unflushed command is waited on
+// replies are parsed in order when a future is waited on, or by poll as far as they already arrived completely
+// the session, the commands and the handlers should outlive the futures
+// thread-safety : safe in distinct, not safe in shared
+template<typename stream_type>
+class batching_session
+{
+private:
+    struct request_state
+    {
+        request_state(reply_handler* handler) : handler(handler), done(false) {}
+
+        reply_handler* handler;
+        std::error_code result;
+        bool done;
+    };
+
+public:
+    class reply_future
+    {
+    public:
+        reply_future() : owner_(nullptr) {}
+
+        bool valid() const
+        {
+            return state_ != nullptr;
+        }
+
+        bool is_ready() const
+        {
+            return state_ != nullptr && state_->done;
+        }
+
+        // flushes the command if it is still buffered, and parses replies up to its own
+        // a default constructed future returns stream_not_initialized
+        std::error_code get()
+        {
+            if (state_ == nullptr) {
+                return redis::error::stream_not_initialized;
+            }
+            if (!state_->done) {
+                owner_->complete_until(*state_);
+            }
+            return state_->result;
+        }
+
+        void wait()
+        {
+            get();
+        }
+
+    private:
+        friend class batching_session;
+
+        reply_future(batching_session* owner, std::shared_ptr<request_state> state) : owner_(owner), state_(std::move(state)) {}
+
+        batching_session* owner_;
+        std::shared_ptr<request_state> state_;
+    };
+
+    batching_session()
+        : max_batch_commands(64), max_batch_bytes(1 << 16), linger(std::chrono::microseconds(200)), unflushed_(0)
+    {
+    }
+
+    template<typename... Args>
+    bool connect(Args&&... args)
+    {
+        return session_.connect(std::forward<Args>(args)...);
+    }
+
+    bool close()
+    {
+        fail_pending(redis::error::stream_error);
+        return session_.close();
+    }
+
+    bool is_open() const
+    {
+        return session_.is_open();
+    }
+
+    session<stream_type>& connection()
+    {
+        return session_;
+    }
+
+    template<typename command_type>
+    reply_future send(command_type& cmd)
+    {
+        return send(cmd, cmd.reply);
+    }
+
+    reply_future send(const command& cmd, reply_handler& handler)
+    {
+        auto state = std::make_shared<request_state>(&handler);
+        reply_future result(this, state);
+
+        if (!session_.is_open()) {
+            finish(*state, redis::error::stream_not_initialized);
+            return result;
+        }
+
+        if (cmd.is_subscriber_cmd()) {
+            finish(*state, redis::error::subscriber_cmd_error);
+            return result;
+        }
+
+        auto ec = cmd.write_command(session_);
+        if (ec) {
+            // the stream buffer may hold a partial command, so nothing written after it can be trusted
+            pending_.push_back(state);
+            fail_pending(session_.close() ? redis::error::stream_error : ec);
+            return result;
+        }
+
+        if (unflushed_ == 0) {
+            oldest_unflushed_ = std::chrono::steady_clock::now();
+        }
+        pending_.push_back(state);
+        unflushed_++;
+
+        if (unflushed_ >= max_batch_commands || session_.pending_output() >= max_batch_bytes || linger_expired()) {
+            flush();
+        }
+        return result;
+    }
+
+    // sends the buffered commands now
+    bool flush()
+    {
+        if (unflushed_ == 0) {
+            return true;
+        }
+
+        unflushed_ = 0;
+        if (!session_.flush()) {
+            session_.close();
+            fail_pending(redis::error::stream_error);
+            return false;
+        }
+        return true;
+    }
+
+    // flushes the buffered commands when they lingered long enough, and parses the replies which already arrived
+    // a reply is parsed only once all of it arrived, so poll does not block on a partly received one
+    // returns the number of completed requests
+    size_t poll()
+    {
+        if (linger_expired()) {
+            flush();
+        }
+
+        size_t completed = 0;
+        while (pending_.size() > unflushed_ && session_.available() > 0) {
+            if (scanner_.scan(session_.peek(session_.available())) == reply_scanner::incomplete) {
+                break;
+            }
+            complete_front(); // an ill-formed reply fails in the parser
+            completed++;
+        }
+        return completed;
+    }
+
+    // number of requests without a reply yet
+    size_t pending() const
+    {
+        return pending_.size();
+    }
+
+    size_t max_batch_commands;
+    size_t max_batch_bytes; // only applied to streams which track pending_output
+    std::chrono::steady_clock::duration linger;
+
+private:
+    bool linger_expired() const
+    {
+        return unflushed_ > 0 && std::chrono::steady_clock::now() - oldest_unflushed_ >= linger;
+    }
+
+    void complete_until(request_state& state)
+    {
+        // flushed requests are at the front of the queue, so flush first if the request is still buffered
+        if (pending_.size() - unflushed_ <= position_of(state)) {
+            flush();
+        }
+
+        while (!state.done && !pending_.empty()) {
+            complete_front();
+        }
+    }
+
+    size_t position_of(const request_state& state) const
+    {
+        size_t position = 0;
+        for (auto i = pending_.begin(), e = pending_.end(); i != e && i->get() != &state; ++i) {
+            position++;
+        }
+        return position;
+    }
+
+    void complete_front()
+    {
+        auto state = pending_.front();
+        pending_.pop_front();
+        scanner_.reset();
+
+        auto ec = redis::parse(session_, *state->handler);
+        finish(*state, ec);
+
+        if (ec && ec != redis::error::error_reply && ec != redis::error::handler_error) {
+            // the rest of the stream can not be trusted anymore
+            session_.close();
+            fail_pending(redis::error::stream_error);
+        }
+    }
+
+    void fail_pending(std::error_code ec)
+    {
+        for (auto i = pending_.begin(), e = pending_.end(); i != e; ++i) {
+            finish(**i, ec);
+        }
+        pending_.clear();
+        unflushed_ = 0;
+    }
+
+    static void finish(request_state& state, std::error_code ec)
+    {
+        state.result = ec;
+        state.done = true;
+    }
+
+    session<stream_type> session_;
+    std::deque<std::shared_ptr<request_state>> pending_; // flushed requests first, then the buffered ones
+    size_t unflushed_;
+    std::chrono::steady_clock::time_point oldest_unflushed_;
+    reply_scanner scanner_; // of the front reply, as far as poll has seen it
+};
+
+} // namespace "redis"
+
+#endif // REDIS_BATCHING_SESSION_H
@@ -0,0 +1,158 @@
+#ifndef REDIS_BUFFER_POOL_H
+#define REDIS_BUFFER_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace redis
+{
+
+// process-wide pool of stream buffers in power-of-two size classes, from 4 KB up to 4 MB
+// blocks are carved out of large slabs (optionally hugepages on Linux) which are kept for the life of the process,
+// and every thread keeps a few free blocks of each class so that most allocations take no lock
+// larger buffers are allocated and freed directly
+// thread-safety : safe in shared
+class buffer_pool
+{
+public:
+    struct options
+    {
+        options() : slab_size(2 << 20), thread_cache_blocks(8), use_huge_pages(false) {}
+
+        size_t slab_size;           // a slab holds at least one block of its class
+        size_t thread_cache_blocks; // free blocks of each class a thread keeps for itself
+        bool use_huge_pages;        // MAP_HUGETLB when hugepages are reserved, transparent hugepages otherwise
+    };
+
+    struct statistics
+    {
+        uint64_t slab_bytes;      // memory reserved by slabs
+        uint64_t pooled_in_use;   // bytes of pooled blocks handed out
+        uint64_t direct_in_use;   // bytes of larger buffers allocated directly
+        uint64_t cache_hits;      // allocations served by the thread cache
+        uint64_t shared_hits;     // allocations served by the shared free lists
+        uint64_t slab_allocations;
+    };
+
+    static const size_t min_block_size = 4096;
+    static const size_t max_block_size = 4 << 20;
+    static const size_t class_count = 11;
+
+    // the options apply when called before the first allocation, returns false afterwards
+    static bool configure(const options& opts);
+
+    static buffer_pool& instance();
+
+    // 'size' is rounded up to the size of the block actually returned
+    char* allocate(size_t& size);
+    void deallocate(char* block, size_t size);
+
+    // size of the block allocate returns for 'size'
+    static size_t block_size(size_t size);
+
+    statistics stats() const;
+
+private:
+    struct thread_cache;
+    friend struct thread_cache;
+
+    explicit buffer_pool(const options& opts);
+
+    static size_t class_of(size_t size);
+    static size_t class_size(size_t index);
+
+    char* allocate_shared(size_t index, std::vector<char*>& cache);
+    void deallocate_shared(size_t index, std::vector<char*>& cache, size_t keep);
+    void allocate_slab(size_t index);
+
+    static char* map_memory(size_t size, bool huge_pages);
+
+    // nullptr once the cache of an exiting thread is destroyed, then blocks go to the shared free lists directly
+    thread_cache* my_cache();
+
+    const options options_;
+
+    std::mutex lock_;
+    std::vector<char*> free_[class_count];
+
+    std::atomic<uint64_t> slab_bytes_;
+    std::atomic<uint64_t> pooled_in_use_;
+    std::atomic<uint64_t> direct_in_use_;
+    std::atomic<uint64_t> cache_hits_;
+    std::atomic<uint64_t> shared_hits_;
+    std::atomic<uint64_t> slab_allocations_;
+};
+
+
+// stream buffer borrowed from the buffer_pool, with the part of the std::vector<char> interface streams use
+// unlike std::vector, resize does not clear the new bytes
+// thread-safety : safe in distinct, not safe in shared
+class pooled_buffer
+{
+public:
+    pooled_buffer() : data_(nullptr), size_(0), capacity_(0) {}
+
+    explicit pooled_buffer(size_t size) : data_(nullptr), size_(0), capacity_(0)
+    {
+        resize(size);
+    }
+
+    pooled_buffer(pooled_buffer&& other) : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    pooled_buffer& operator=(pooled_buffer&& other)
+    {
+        if (this != &other) {
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+
+    pooled_buffer(const pooled_buffer&) = delete;
+    pooled_buffer& operator=(const pooled_buffer&) = delete;
+
+    ~pooled_buffer()
+    {
+        release();
+    }
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    char* begin() { return data_; }
+    char* end() { return data_ + size_; }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    // keeps the content up to the new size
+    void resize(size_t size);
+
+    void swap(pooled_buffer& other)
+    {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    // returns the block to the pool
+    void release();
+
+private:
+    char* data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_BUFFER_POOL_H
@@ -31,6 +31,14 @@ struct single_key_command : public command
     std::string key;
 };
 
+struct read_key_command : public single_key_command
+{
+    virtual bool is_read_only() const override
+    {
+        return true;
+    }
+};
+
 
 struct subscriber_command : public command
 {
@@ -45,6 +53,30 @@ struct subscriber_command : public command
     }
 };
 
+namespace detail
+{
+
+// number of elements between two indexes of a range command, negative indexes count from the end of the collection
+inline size_t range_reply_size(int32_t start, int32_t stop)
+{
+    if (start < 0 || stop < 0) {
+        return unbounded_reply_size;
+    }
+    return stop >= start ? static_cast<size_t>(stop - start) + 1 : 0;
+}
+
+inline size_t limit_reply_size(bool use_limit, int32_t limit_count)
+{
+    return use_limit && limit_count >= 0 ? static_cast<size_t>(limit_count) : unbounded_reply_size;
+}
+
+inline size_t scored_reply_size(size_t size, bool with_scores)
+{
+    return with_scores && size != unbounded_reply_size ? size * 2 : size;
+}
+
+} // namespace "redis::detail"
+
 // ad-hoc command
 template<typename cmd_functor>
 struct adhoc_key_command : public command
@@ -111,8 +143,8 @@ inline adhoc_command<cmd_functor> make_command(cmd_functor&& cmd)
 }
 
 
-#define DECLARE_KEY_CMD(cmd_name, handler_type)\
-struct cmd_name : public single_key_command\
+#define DECLARE_KEY_CMD_OF(cmd_name, base_type, handler_type)\
+struct cmd_name : public base_type\
 {\
     virtual std::error_code write_command(stream& output) const override\
     {\
@@ -122,8 +154,27 @@ struct cmd_name : public single_key_command\
     handler_type reply;\
 };
 
-#define DECLARE_KEY_VALUE_CMD(cmd_name, value_type, value_name, handler_type)\
-struct cmd_name : public single_key_command\
+#define DECLARE_KEY_CMD(cmd_name, handler_type) DECLARE_KEY_CMD_OF(cmd_name, single_key_command, handler_type)
+#define DECLARE_READ_KEY_CMD(cmd_name, handler_type) DECLARE_KEY_CMD_OF(cmd_name, read_key_command, handler_type)
+
+#define DECLARE_COLLECTION_KEY_CMD(cmd_name, handler_type)\
+struct cmd_name : public read_key_command\
+{\
+    virtual std::error_code write_command(stream& output) const override\
+    {\
+        return format_command(output, #cmd_name, key);\
+    }\
+    \
+    virtual size_t reply_size_hint() const override\
+    {\
+        return unbounded_reply_size;\
+    }\
+    \
+    handler_type reply;\
+};
+
+#define DECLARE_KEY_VALUE_CMD_OF(cmd_name, base_type, value_type, value_name, handler_type)\
+struct cmd_name : public base_type\
 {\
     cmd_name() : value_name(value_type()) {}\
     virtual std::error_code write_command(stream& output) const override\
@@ -135,6 +186,11 @@ struct cmd_name : public single_key_command\
     handler_type reply;\
 }
 
+#define DECLARE_KEY_VALUE_CMD(cmd_name, value_type, value_name, handler_type)\
+    DECLARE_KEY_VALUE_CMD_OF(cmd_name, single_key_command, value_type, value_name, handler_type)
+#define DECLARE_READ_KEY_VALUE_CMD(cmd_name, value_type, value_name, handler_type)\
+    DECLARE_KEY_VALUE_CMD_OF(cmd_name, read_key_command, value_type, value_name, handler_type)
+
 #define DECLARE_GENERIC_KEY_VALUE_CMD(cmd_name, value_name, handler_type)\
 template<typename T>\
 struct cmd_name : public single_key_command\
@@ -152,9 +208,9 @@ struct cmd_name : public single_key_command\
     handler_type reply;\
 }
 
-#define DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(cmd_name, value_name, handler_type)\
+#define DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD_OF(cmd_name, base_type, value_name, handler_type)\
 template<typename T>\
-struct cmd_name : public single_key_command\
+struct cmd_name : public base_type\
 {\
     static_assert(is_single_element_type<T>::value, "T should be represented in a single string.");\
     cmd_name() : value_name(T()) {}\
@@ -167,23 +223,28 @@ struct cmd_name : public single_key_command\
     handler_type reply;\
 }
 
+#define DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(cmd_name, value_name, handler_type)\
+    DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD_OF(cmd_name, single_key_command, value_name, handler_type)
+#define DECLARE_GENERIC_READ_KEY_SINGLE_VALUE_CMD(cmd_name, value_name, handler_type)\
+    DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD_OF(cmd_name, read_key_command, value_name, handler_type)
+
 
 // key-related commands
 DECLARE_KEY_CMD(DEL, integer_reply); // make it single key command to support cluster
-DECLARE_KEY_CMD(EXISTS, boolean_reply);
+DECLARE_READ_KEY_CMD(EXISTS, boolean_reply);
 DECLARE_KEY_CMD(PERSIST, boolean_reply);
-DECLARE_KEY_CMD(TYPE, status_reply);
+DECLARE_READ_KEY_CMD(TYPE, status_reply);
 DECLARE_KEY_VALUE_CMD(EXPIRE, int32_t, time_to_live, boolean_reply);
 DECLARE_KEY_VALUE_CMD(PEXPIRE, int32_t, time_to_live_ms, boolean_reply);
 DECLARE_KEY_VALUE_CMD(EXPIREAT, int32_t, expire_time, boolean_reply);
 DECLARE_KEY_VALUE_CMD(PEXPIREAT, int32_t, expire_time_ms, boolean_reply);
-DECLARE_KEY_CMD(TTL, integer_reply);
-DECLARE_KEY_CMD(PTTL, integer_reply);
+DECLARE_READ_KEY_CMD(TTL, integer_reply);
+DECLARE_READ_KEY_CMD(PTTL, integer_reply);
 
 // string-related commands
 DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(APPEND, value, integer_reply);
-DECLARE_KEY_CMD(GET, bulk_reply);
-DECLARE_KEY_CMD(STRLEN, integer_reply);
+DECLARE_READ_KEY_CMD(GET, bulk_reply);
+DECLARE_READ_KEY_CMD(STRLEN, integer_reply);
 DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(SET, value, boolean_reply);
 DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(GETSET, value, bulk_reply);
 DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(SETNX, value, boolean_reply);
@@ -222,7 +283,7 @@ struct PSETEX : public single_key_command
     boolean_reply reply;
 };
 
-struct GETRANGE : public single_key_command
+struct GETRANGE : public read_key_command
 {
     GETRANGE() : start(0), end(0) {}
 
@@ -256,13 +317,28 @@ struct SETRANGE : public single_key_command
 
 // hash-related commands
 DECLARE_KEY_VALUE_CMD(HDEL, std::vector<std::string>, fields, integer_reply);
-DECLARE_KEY_VALUE_CMD(HEXISTS, std::string, field, boolean_reply);
-DECLARE_KEY_VALUE_CMD(HGET, std::string, field, bulk_reply);
-DECLARE_KEY_CMD(HGETALL, multi_bulk_reply);
-DECLARE_KEY_CMD(HKEYS, multi_bulk_reply);
-DECLARE_KEY_CMD(HVALS, multi_bulk_reply);
-DECLARE_KEY_CMD(HLEN, integer_reply);
-DECLARE_KEY_VALUE_CMD(HMGET, std::vector<std::string>, fields, multi_bulk_reply);
+DECLARE_READ_KEY_VALUE_CMD(HEXISTS, std::string, field, boolean_reply);
+DECLARE_READ_KEY_VALUE_CMD(HGET, std::string, field, bulk_reply);
+DECLARE_COLLECTION_KEY_CMD(HGETALL, multi_bulk_reply);
+DECLARE_COLLECTION_KEY_CMD(HKEYS, multi_bulk_reply);
+DECLARE_COLLECTION_KEY_CMD(HVALS, multi_bulk_reply);
+DECLARE_READ_KEY_CMD(HLEN, integer_reply);
+
+struct HMGET : public read_key_command
+{
+    virtual std::error_code write_command(stream& output) const override
+    {
+        return format_command(output, "HMGET", key, fields);
+    }
+
+    virtual size_t reply_size_hint() const override
+    {
+        return fields.size();
+    }
+
+    std::vector<std::string> fields;
+    multi_bulk_reply reply;
+};
 
 template<typename key_type, typename value_type>
 struct HSET : public single_key_command
@@ -320,8 +396,8 @@ struct HMSET : public single_key_command
 };
 
 // list-related commands
-DECLARE_KEY_VALUE_CMD(LINDEX, int32_t, index, bulk_reply);
-DECLARE_KEY_CMD(LLEN, integer_reply);
+DECLARE_READ_KEY_VALUE_CMD(LINDEX, int32_t, index, bulk_reply);
+DECLARE_READ_KEY_CMD(LLEN, integer_reply);
 
 DECLARE_KEY_CMD(LPOP, bulk_reply);
 DECLARE_GENERIC_KEY_VALUE_CMD(LPUSH, values, integer_reply);
@@ -350,7 +426,7 @@ struct LINSERT : public single_key_command
     integer_reply reply;
 };
 
-struct LRANGE : public single_key_command
+struct LRANGE : public read_key_command
 {
     LRANGE() : start(0), stop(0) {}
 
@@ -359,6 +435,11 @@ struct LRANGE : public single_key_command
         return format_command(output, "LRANGE", key, start, stop);
     }
 
+    virtual size_t reply_size_hint() const override
+    {
+        return detail::range_reply_size(start, stop);
+    }
+
     int32_t start;
     int32_t stop;
     multi_bulk_reply reply;
@@ -417,9 +498,9 @@ struct LSET : public single_key_command
 
 // set-related commands
 DECLARE_GENERIC_KEY_VALUE_CMD(SADD, members, integer_reply);
-DECLARE_KEY_CMD(SCARD, integer_reply);
-DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(SISMEMBER, member, boolean_reply);
-DECLARE_KEY_CMD(SMEMBERS, multi_bulk_reply);
+DECLARE_READ_KEY_CMD(SCARD, integer_reply);
+DECLARE_GENERIC_READ_KEY_SINGLE_VALUE_CMD(SISMEMBER, member, boolean_reply);
+DECLARE_COLLECTION_KEY_CMD(SMEMBERS, multi_bulk_reply);
 DECLARE_GENERIC_KEY_VALUE_CMD(SREM, member, integer_reply);
 
 // sorted set-related commands
@@ -478,11 +559,11 @@ struct writer_type_traits<interval_value>
     }
 };
 
-DECLARE_KEY_CMD(ZCARD, integer_reply);
-DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(ZRANK, member, rank_reply);
+DECLARE_READ_KEY_CMD(ZCARD, integer_reply);
+DECLARE_GENERIC_READ_KEY_SINGLE_VALUE_CMD(ZRANK, member, rank_reply);
 DECLARE_GENERIC_KEY_VALUE_CMD(ZREM, member, integer_reply);
-DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(ZREVRANK, member, rank_reply);
-DECLARE_GENERIC_KEY_SINGLE_VALUE_CMD(ZSCORE, member, bulk_reply);
+DECLARE_GENERIC_READ_KEY_SINGLE_VALUE_CMD(ZREVRANK, member, rank_reply);
+DECLARE_GENERIC_READ_KEY_SINGLE_VALUE_CMD(ZSCORE, member, bulk_reply);
 
 template<typename score_type, typename member_type>
 struct ZADD : public single_key_command
@@ -502,7 +583,7 @@ struct ZADD : public single_key_command
     integer_reply reply;
 };
 
-struct ZCOUNT : public single_key_command
+struct ZCOUNT : public read_key_command
 {
     virtual std::error_code write_command(stream& output) const override
     {
@@ -514,7 +595,7 @@ struct ZCOUNT : public single_key_command
     integer_reply reply;
 };
 
-struct ZRANGE : public single_key_command
+struct ZRANGE : public read_key_command
 {
     ZRANGE() : start(0), stop(0), with_scores(false) {}
 
@@ -523,13 +604,18 @@ struct ZRANGE : public single_key_command
         return format_command(output, "ZRANGE", key, start, stop, optional(with_scores, "WITHSCORES"));
     }
 
+    virtual size_t reply_size_hint() const override
+    {
+        return detail::scored_reply_size(detail::range_reply_size(start, stop), with_scores);
+    }
+
     int32_t start;
     int32_t stop;
     bool with_scores;
     multi_bulk_reply reply;
 };
 
-struct ZRANGEBYSCORE : public single_key_command
+struct ZRANGEBYSCORE : public read_key_command
 {
     ZRANGEBYSCORE() : with_scores(false), use_limit(false), limit_offset(0), limit_count(0) {}
 
@@ -540,6 +626,11 @@ struct ZRANGEBYSCORE : public single_key_command
             optional(use_limit, "LIMIT", limit_offset, limit_count));
     }
 
+    virtual size_t reply_size_hint() const override
+    {
+        return detail::scored_reply_size(detail::limit_reply_size(use_limit, limit_count), with_scores);
+    }
+
     interval_value min;
     interval_value max;
     bool with_scores;
@@ -576,7 +667,7 @@ struct ZREMRANGEBYSCORE : public single_key_command
     integer_reply reply;
 };
 
-struct ZREVRANGE : public single_key_command
+struct ZREVRANGE : public read_key_command
 {
     ZREVRANGE() : start(0), stop(0), with_scores(false) {}
 
@@ -585,13 +676,18 @@ struct ZREVRANGE : public single_key_command
         return format_command(output, "ZREVRANGE", key, start, stop, optional(with_scores, "WITHSCORES"));
     }
 
+    virtual size_t reply_size_hint() const override
+    {
+        return detail::scored_reply_size(detail::range_reply_size(start, stop), with_scores);
+    }
+
     int32_t start;
     int32_t stop;
     bool with_scores;
     multi_bulk_reply reply;
 };
 
-struct ZREVRANGEBYSCORE : public single_key_command
+struct ZREVRANGEBYSCORE : public read_key_command
 {
     ZREVRANGEBYSCORE() : with_scores(false), use_limit(false), limit_offset(0), limit_count(0) {}
 
@@ -602,6 +698,11 @@ struct ZREVRANGEBYSCORE : public single_key_command
             optional(use_limit, "LIMIT", limit_offset, limit_count));
     }
 
+    virtual size_t reply_size_hint() const override
+    {
+        return detail::scored_reply_size(detail::limit_reply_size(use_limit, limit_count), with_scores);
+    }
+
     interval_value min;
     interval_value max;
     bool with_scores;
@@ -0,0 +1,343 @@
+#ifndef REDIS_CONNECTION_POOL_H
+#define REDIS_CONNECTION_POOL_H
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+
+namespace redis
+{
+
+struct pool_stats
+{
+    pool_stats() : checkouts(0), thread_cache_hits(0), shared_hits(0), created(0), reconnects(0), failures(0), waits(0), wait_time(0) {}
+
+    // fraction of checkouts served by an idle connection, without connecting or waiting
+    double hit_rate() const
+    {
+        return checkouts > 0 ? static_cast<double>(thread_cache_hits + shared_hits) / checkouts : 0;
+    }
+
+    uint64_t checkouts;
+    uint64_t thread_cache_hits; // served by the calling thread's cache slot
+    uint64_t shared_hits;       // served by the shared free list
+    uint64_t created;           // connections created lazily
+    uint64_t reconnects;        // connections which failed the health check and were connected again
+    uint64_t failures;          // checkouts which returned nothing, by time out or connection failure
+    uint64_t waits;             // checkouts which had to wait for a connection to be returned
+    std::chrono::nanoseconds wait_time;
+};
+
+// pool of up to 'max_size' sessions, created lazily
+// a returned connection goes to a cache slot of the returning thread, so that a thread checking out again gets it back
+// with a single exchange - other connections are kept in a lock-free free list
+// every connection is health-checked at checkout, and connected again when the check fails
+// thread-safety : safe in shared, a checked out connection belongs to its handle
+template<typename stream_type>
+class connection_pool
+{
+private:
+    struct entry;
+
+public:
+    typedef std::function<bool(session<stream_type>& connection)> connector_type;
+    typedef std::function<bool(session<stream_type>& connection)> health_check_type;
+
+    struct options
+    {
+        options() : max_size(16), thread_cache_slots(64), wait_timeout(std::chrono::milliseconds(1000)) {}
+
+        size_t max_size;
+        size_t thread_cache_slots; // threads share a slot when there are more threads than slots
+        std::chrono::milliseconds wait_timeout;
+    };
+
+    // returns the connection to the pool on destruction
+    class handle
+    {
+    public:
+        handle() : pool_(nullptr), entry_(nullptr) {}
+        handle(handle&& other) : pool_(other.pool_), entry_(other.entry_)
+        {
+            other.entry_ = nullptr;
+        }
+
+        handle& operator=(handle&& other)
+        {
+            if (this != &other) {
+                reset();
+                pool_ = other.pool_;
+                entry_ = other.entry_;
+                other.entry_ = nullptr;
+            }
+            return *this;
+        }
+
+        ~handle()
+        {
+            reset();
+        }
+
+        explicit operator bool() const
+        {
+            return entry_ != nullptr;
+        }
+
+        session<stream_type>& operator*() const
+        {
+            return *entry_->connection;
+        }
+
+        session<stream_type>* operator->() const
+        {
+            return entry_->connection.get();
+        }
+
+        void reset()
+        {
+            if (entry_ != nullptr) {
+                pool_->give_back(entry_);
+                entry_ = nullptr;
+            }
+        }
+
+    private:
+        friend class connection_pool;
+
+        handle(connection_pool* pool, entry* e) : pool_(pool), entry_(e) {}
+        handle(const handle&) = delete;
+        handle& operator=(const handle&) = delete;
+
+        connection_pool* pool_;
+        entry* entry_;
+    };
+
+    // connections are healthy while their stream is open, unless 'health_check' says otherwise
+    connection_pool(connector_type connector, const options& opts = options(), health_check_type health_check = health_check_type())
+        : connector_(std::move(connector)), health_check_(std::move(health_check)), options_(opts),
+          entries_(new entry[opts.max_size]), slots_(new thread_slot[opts.thread_cache_slots > 0 ? opts.thread_cache_slots : 1]),
+          slot_count_(opts.thread_cache_slots > 0 ? opts.thread_cache_slots : 1), created_(0), free_head_(0)
+    {
+        for (size_t i = 0; i < options_.max_size; i++) {
+            entries_[i].index = static_cast<uint32_t>(i);
+        }
+    }
+
+    // every handle should be returned before the pool is destroyed
+    ~connection_pool()
+    {
+        for (size_t i = 0; i < options_.max_size; i++) {
+            if (entries_[i].connection) {
+                entries_[i].connection->close();
+            }
+        }
+    }
+
+    // returns an empty handle when no connection is returned within wait_timeout, or connecting failed
+    handle checkout()
+    {
+        auto& slot = my_slot();
+        slot.checkouts.fetch_add(1, std::memory_order_relaxed);
+
+        bool created = false;
+        auto e = slot.cached.exchange(nullptr, std::memory_order_acquire);
+        if (e != nullptr) {
+            slot.thread_cache_hits.fetch_add(1, std::memory_order_relaxed);
+        } else if ((e = pop_free()) != nullptr) {
+            slot.shared_hits.fetch_add(1, std::memory_order_relaxed);
+        } else if ((e = create()) != nullptr) {
+            slot.created.fetch_add(1, std::memory_order_relaxed);
+            created = true;
+        } else {
+            e = wait_for_connection(slot);
+        }
+
+        if (e == nullptr) {
+            slot.failures.fetch_add(1, std::memory_order_relaxed);
+            return handle();
+        }
+
+        if (created || !healthy(*e)) {
+            if (!created) {
+                e->connection->close();
+                slot.reconnects.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (!connector_(*e->connection)) {
+                e->connection->close();
+                push_free(e); // connected again by the next checkout
+                slot.failures.fetch_add(1, std::memory_order_relaxed);
+                return handle();
+            }
+        }
+        return handle(this, e);
+    }
+
+    pool_stats stats() const
+    {
+        pool_stats result;
+        for (size_t i = 0; i < slot_count_; i++) {
+            auto& slot = slots_[i];
+            result.checkouts += slot.checkouts.load(std::memory_order_relaxed);
+            result.thread_cache_hits += slot.thread_cache_hits.load(std::memory_order_relaxed);
+            result.shared_hits += slot.shared_hits.load(std::memory_order_relaxed);
+            result.created += slot.created.load(std::memory_order_relaxed);
+            result.reconnects += slot.reconnects.load(std::memory_order_relaxed);
+            result.failures += slot.failures.load(std::memory_order_relaxed);
+            result.waits += slot.waits.load(std::memory_order_relaxed);
+            result.wait_time += std::chrono::nanoseconds(slot.wait_nanoseconds.load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+    // number of connections created so far
+    size_t size() const
+    {
+        return std::min(created_.load(std::memory_order_acquire), options_.max_size);
+    }
+
+private:
+    struct entry
+    {
+        entry() : index(0), next(0) {}
+
+        std::unique_ptr<session<stream_type>> connection;
+        uint32_t index;
+        std::atomic<uint32_t> next; // index + 1 of the next free entry, zero at the end
+    };
+
+    // statistics live in the slots too, so that counting does not make threads share a cache line
+    struct alignas(64) thread_slot
+    {
+        thread_slot() : cached(nullptr), checkouts(0), thread_cache_hits(0), shared_hits(0), created(0), reconnects(0), failures(0), waits(0), wait_nanoseconds(0) {}
+
+        std::atomic<entry*> cached;
+        std::atomic<uint64_t> checkouts;
+        std::atomic<uint64_t> thread_cache_hits;
+        std::atomic<uint64_t> shared_hits;
+        std::atomic<uint64_t> created;
+        std::atomic<uint64_t> reconnects;
+        std::atomic<uint64_t> failures;
+        std::atomic<uint64_t> waits;
+        std::atomic<uint64_t> wait_nanoseconds;
+    };
+
+    static size_t thread_index()
+    {
+        static std::atomic<size_t> next_index(0);
+        thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    thread_slot& my_slot()
+    {
+        return slots_[thread_index() % slot_count_];
+    }
+
+    bool healthy(entry& e)
+    {
+        if (!e.connection->is_open()) {
+            return false;
+        }
+        return !health_check_ || health_check_(*e.connection);
+    }
+
+    entry* create()
+    {
+        auto created = created_.load(std::memory_order_relaxed);
+        do {
+            if (created >= options_.max_size) {
+                return nullptr;
+            }
+        } while (!created_.compare_exchange_weak(created, created + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        auto e = &entries_[created];
+        e->connection.reset(new session<stream_type>());
+        return e;
+    }
+
+    entry* wait_for_connection(thread_slot& slot)
+    {
+        auto started = std::chrono::steady_clock::now();
+        auto deadline = started + options_.wait_timeout;
+        entry* e = nullptr;
+
+        for (size_t spins = 0; e == nullptr; spins++) {
+            e = pop_free();
+
+            // connections idle in other threads' cache slots are taken as well
+            for (size_t i = 0; i < slot_count_ && e == nullptr; i++) {
+                e = slots_[i].cached.exchange(nullptr, std::memory_order_acquire);
+            }
+
+            if (e != nullptr || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+
+            if (spins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+
+        auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+        slot.waits.fetch_add(1, std::memory_order_relaxed);
+        slot.wait_nanoseconds.fetch_add(static_cast<uint64_t>(waited.count()), std::memory_order_relaxed);
+        return e;
+    }
+
+    void give_back(entry* e)
+    {
+        entry* expected = nullptr;
+        if (!my_slot().cached.compare_exchange_strong(expected, e, std::memory_order_release, std::memory_order_relaxed)) {
+            push_free(e);
+        }
+    }
+
+    // the free list head packs a version tag with the entry index, so that a pop racing with pop and push (ABA) fails
+    void push_free(entry* e)
+    {
+        auto head = free_head_.load(std::memory_order_relaxed);
+        uint64_t new_head;
+        do {
+            e->next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            new_head = (((head >> 32) + 1) << 32) | (e->index + 1);
+        } while (!free_head_.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    entry* pop_free()
+    {
+        auto head = free_head_.load(std::memory_order_acquire);
+        while (static_cast<uint32_t>(head) != 0) {
+            auto e = &entries_[static_cast<uint32_t>(head) - 1];
+            auto new_head = (((head >> 32) + 1) << 32) | e->next.load(std::memory_order_relaxed);
+            if (free_head_.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+                return e;
+            }
+        }
+        return nullptr;
+    }
+
+    connector_type connector_;
+    health_check_type health_check_;
+    options options_;
+
+    std::unique_ptr<entry[]> entries_;
+    std::unique_ptr<thread_slot[]> slots_;
+    size_t slot_count_;
+
+    std::atomic<size_t> created_;
+    std::atomic<uint64_t> free_head_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_CONNECTION_POOL_H
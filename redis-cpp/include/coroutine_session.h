@@ -0,0 +1,238 @@
+#ifndef REDIS_COROUTINE_SESSION_H
+#define REDIS_COROUTINE_SESSION_H
+
+// C++20 coroutines only - the header is empty for older language modes
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define REDIS_HAS_COROUTINES 1
+#endif
+
+#ifdef REDIS_HAS_COROUTINES
+
+#include <coroutine>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <system_error>
+
+#include "redis_base.h"
+#include "reply_scanner.h"
+
+namespace redis
+{
+
+// a connection shared by coroutines of a single thread
+// 'co_await conn.request(cmd)' suspends the coroutine until the reply of 'cmd' is parsed into its handler
+// poll sends the requests queued since the last poll with one flush, and resumes the coroutines whose replies already
+// arrived completely, in request order - it never waits for the network, so one thread can drive many coroutines
+// and do other work in between, or wait for the stream itself (wait_readable) when it has nothing else to do
+// run drives the coroutines until none waits, blocking on the stream for the replies
+// thread-safety : safe in distinct, not safe in shared
+template<typename stream_type>
+class coroutine_session
+{
+public:
+    class request_awaiter
+    {
+    public:
+        request_awaiter(coroutine_session& owner, const command& cmd, reply_handler& handler)
+            : owner_(owner), cmd_(&cmd), handler_(&handler)
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        // returns false to resume at once when there is no connection to queue the request on
+        bool await_suspend(std::coroutine_handle<> waiting)
+        {
+            if (!owner_.session_.is_open()) {
+                result_ = redis::error::stream_not_initialized;
+                return false;
+            }
+
+            waiting_ = waiting;
+            owner_.pending_.push_back(this);
+            return true;
+        }
+
+        std::error_code await_resume() const noexcept
+        {
+            return result_;
+        }
+
+    private:
+        friend class coroutine_session;
+
+        coroutine_session& owner_;
+        const command* cmd_;
+        reply_handler* handler_;
+        std::coroutine_handle<> waiting_;
+        std::error_code result_;
+    };
+
+    template<typename... Args>
+    bool connect(Args&&... args)
+    {
+        return session_.connect(std::forward<Args>(args)...);
+    }
+
+    bool close()
+    {
+        return session_.close();
+    }
+
+    bool is_open() const
+    {
+        return session_.is_open();
+    }
+
+    // the underlying session, for stream settings and requests outside coroutines
+    session<stream_type>& connection()
+    {
+        return session_;
+    }
+
+    template<typename command_type>
+    request_awaiter request(command_type& cmd)
+    {
+        return request(cmd, cmd.reply);
+    }
+
+    request_awaiter request(const command& cmd, reply_handler& handler)
+    {
+        return request_awaiter(*this, cmd, handler);
+    }
+
+    // number of coroutines waiting for a reply, sent or not
+    size_t pending() const
+    {
+        return pending_.size() + in_flight_.size();
+    }
+
+    // sends the requests queued so far with one flush, and resumes the coroutines whose replies arrived completely
+    // a reply is parsed only once all of it arrived, so poll does not block on a partly received one
+    // requests made by the resumed coroutines are sent by the next poll
+    // returns the number of resumed coroutines
+    size_t poll()
+    {
+        std::vector<std::coroutine_handle<>> resumed;
+        send_pending(resumed);
+
+        if (!session_.is_open()) {
+            // closed with requests in flight, their replies never come
+            fail(in_flight_.begin(), in_flight_.end(), redis::error::stream_error, resumed);
+            in_flight_.clear();
+        }
+
+        while (!in_flight_.empty() && session_.available() > 0) {
+            if (scanner_.scan(session_.peek(session_.available())) == reply_scanner::incomplete) {
+                break;
+            }
+            complete_front(resumed); // an ill-formed reply fails in the parser
+        }
+
+        return resume(resumed);
+    }
+
+    // polls until no coroutine waits for a reply, blocking on the stream for the replies which did not arrive yet
+    void run()
+    {
+        while (pending() > 0) {
+            if (poll() == 0 && !in_flight_.empty()) {
+                std::vector<std::coroutine_handle<>> resumed;
+                complete_front(resumed);
+                resume(resumed);
+            }
+        }
+    }
+
+private:
+    void send_pending(std::vector<std::coroutine_handle<>>& resumed)
+    {
+        if (pending_.empty()) {
+            return;
+        }
+
+        std::vector<request_awaiter*> batch;
+        batch.swap(pending_);
+
+        if (!session_.is_open()) {
+            fail(batch.begin(), batch.end(), redis::error::stream_not_initialized, resumed);
+            return;
+        }
+
+        for (auto i = batch.begin(), e = batch.end(); i != e; ++i) {
+            if ((*i)->cmd_->is_subscriber_cmd()) {
+                (*i)->result_ = redis::error::subscriber_cmd_error;
+                resumed.push_back((*i)->waiting_);
+                continue;
+            }
+
+            auto ec = (*i)->cmd_->write_command(session_);
+            if (ec) {
+                // the stream buffer may hold a partial command, so nothing written with it can be trusted
+                ec = session_.close() ? redis::error::stream_error : ec;
+                fail(in_flight_.begin(), in_flight_.end(), redis::error::stream_error, resumed);
+                in_flight_.clear();
+                fail(i, e, ec, resumed);
+                return;
+            }
+            in_flight_.push_back(*i);
+        }
+
+        if (!session_.flush()) {
+            session_.close();
+            fail(in_flight_.begin(), in_flight_.end(), redis::error::stream_error, resumed);
+            in_flight_.clear();
+        }
+    }
+
+    void complete_front(std::vector<std::coroutine_handle<>>& resumed)
+    {
+        auto front = in_flight_.front();
+        in_flight_.pop_front();
+        scanner_.reset();
+
+        auto ec = session_.is_open() ? redis::parse(session_, *front->handler_) : std::error_code(redis::error::stream_error);
+        front->result_ = ec;
+        resumed.push_back(front->waiting_);
+
+        if (ec && ec != redis::error::error_reply && ec != redis::error::handler_error) {
+            // the rest of the stream can not be trusted anymore
+            session_.close();
+            fail(in_flight_.begin(), in_flight_.end(), redis::error::stream_error, resumed);
+            in_flight_.clear();
+        }
+    }
+
+    template<typename iterator>
+    static void fail(iterator i, iterator e, std::error_code ec, std::vector<std::coroutine_handle<>>& resumed)
+    {
+        for (; i != e; ++i) {
+            (*i)->result_ = ec;
+            resumed.push_back((*i)->waiting_);
+        }
+    }
+
+    // a resumed coroutine may end and destroy its awaiter, so the handles are taken out before any is resumed
+    static size_t resume(const std::vector<std::coroutine_handle<>>& resumed)
+    {
+        for (auto i = resumed.begin(), e = resumed.end(); i != e; ++i) {
+            i->resume();
+        }
+        return resumed.size();
+    }
+
+    session<stream_type> session_;
+    std::vector<request_awaiter*> pending_;    // not sent yet
+    std::deque<request_awaiter*> in_flight_;   // sent, in the order of their replies
+    reply_scanner scanner_;                    // of the front reply, as far as poll has seen it
+};
+
+} // namespace "redis"
+
+#endif // REDIS_HAS_COROUTINES
+
+#endif // REDIS_COROUTINE_SESSION_H
@@ -18,6 +18,9 @@ enum error_t
     ill_formed_reply,
     stream_not_initialized,
     stream_error,	
+    timed_out,
+    no_connection,
+    no_pending_request,
 };
 
 std::error_code make_error_code(error_t e);
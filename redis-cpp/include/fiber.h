@@ -0,0 +1,161 @@
+#ifndef REDIS_FIBER_H
+#define REDIS_FIBER_H
+
+// ucontext and epoll based - the header is empty for other platforms
+#ifdef __linux__
+#define REDIS_HAS_FIBERS 1
+#endif
+
+#ifdef REDIS_HAS_FIBERS
+
+#include <deque>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <cstdint>
+
+#include <ucontext.h>
+
+#include "redis_base.h"
+#include "buffer_pool.h"
+
+namespace redis
+{
+
+// cooperative scheduler running fibers on the thread which calls run
+// a fiber gives up the thread only in yield or wait_fd, so blocking-style code (session::request over a fiber_stream)
+// runs unchanged while thousands of such sessions share one thread - one scheduler per thread spreads them over a few more
+// thread-safety : safe in distinct, not safe in shared
+class fiber_scheduler
+{
+public:
+    typedef std::function<void()> entry_type;
+
+    fiber_scheduler();
+    ~fiber_scheduler();
+
+    fiber_scheduler(const fiber_scheduler&) = delete;
+    fiber_scheduler& operator=(const fiber_scheduler&) = delete;
+
+    // the fiber starts at the next run, a parse of deeply nested replies needs a larger stack than the default
+    void spawn(entry_type entry, size_t stack_size = 64 * 1024);
+
+    // runs the fibers until every one of them finished
+    // an exception escaping a fiber is rethrown here once the other fibers finished
+    void run();
+
+    // number of fibers not finished yet
+    size_t size() const
+    {
+        return fibers_.size();
+    }
+
+    // the scheduler running the calling fiber, nullptr outside of a fiber
+    static fiber_scheduler* current();
+
+    // lets the other ready fibers run before the calling one continues
+    void yield();
+
+    // parks the calling fiber until 'fd' is ready for 'events' (EPOLLIN, EPOLLOUT), or has an error or hang-up
+    // returns false when the fd can not be watched, or when 'deadline' passed first
+    bool wait_fd(int fd, uint32_t events);
+    bool wait_fd(int fd, uint32_t events, std::chrono::steady_clock::time_point deadline);
+
+private:
+    struct fiber;
+    typedef std::multimap<std::chrono::steady_clock::time_point, fiber*> timer_map;
+
+    struct fiber
+    {
+        ucontext_t context;
+        std::unique_ptr<char[]> stack;
+        entry_type entry;
+        size_t index; // in fibers_
+        bool finished;
+
+        int waiting_fd; // -1 unless parked in wait_fd
+        bool timed_out;
+        bool has_timer;
+        timer_map::iterator timer;
+    };
+
+    static void start_fiber();
+    void switch_to_scheduler();
+    void resume(fiber* f);
+    void poll_events(int timeout);
+    int next_timeout() const;
+    void expire_timers();
+
+    std::vector<std::unique_ptr<fiber>> fibers_;
+    std::deque<fiber*> ready_;
+    size_t waiting_;
+    int epoll_fd_;
+    timer_map timers_; // deadlines of the parked fibers
+
+    fiber* running_;
+    ucontext_t scheduler_context_;
+    std::exception_ptr error_;
+};
+
+
+// non-blocking TCP stream which parks the calling fiber instead of blocking the thread
+// outside of a fiber it blocks the thread in poll, so it can be connected or drained before the scheduler runs
+// thread-safety : safe in distinct, not safe in shared
+struct fiber_stream : public stream
+{
+public:
+    fiber_stream(size_t initial_buffer_size = 16384);
+    ~fiber_stream();
+
+    // redis::stream interface implementation
+    virtual bool close() override;
+    virtual bool is_open() const override;
+
+    // redis::stream input interface implementation
+    virtual size_t available() const override;
+    virtual const_buffer_view peek(size_t n) override;
+    virtual const_buffer_view read(size_t n) override;
+    virtual size_t skip(size_t n) override;
+    virtual bool wait_readable(std::chrono::milliseconds timeout) override;
+
+    // redis::stream output interface implementation
+    virtual bool flush() override;
+    virtual bool write(const_buffer_view input) override;
+    virtual size_t pending_output() const override;
+
+    // fiber_stream member functions
+    // the name resolution blocks the thread, the connection itself only parks the fiber
+    bool connect(const std::string& host, uint16_t port);
+
+    // takes over a connected socket, which is made non-blocking
+    bool attach(int fd);
+
+private:
+    // utility functions
+    void reset();
+    bool wait(uint32_t events);
+
+    std::pair<buffer_view, buffer_view> ensure_available_buffer(size_t at_least);
+    bool read_from_socket(size_t at_least);
+    void move_and_ensure_read_buffer(size_t at_least);
+
+    buffer_view unused_read_buffer();
+
+private:
+    int fd_;
+    pooled_buffer read_buffer_;
+    pooled_buffer write_buffer_;
+    buffer_view to_be_read_;
+    size_t written_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_HAS_FIBERS
+
+#endif // REDIS_FIBER_H
@@ -0,0 +1,251 @@
+#ifndef REDIS_HEDGED_CLIENT_H
+#define REDIS_HEDGED_CLIENT_H
+
+#include <atomic>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <typeinfo>
+#include <typeindex>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "connection_pool.h"
+#include "latency_stats.h"
+
+namespace redis
+{
+
+struct hedge_stats
+{
+    hedge_stats() : requests(0), hedges(0), hedge_wins(0), throttled(0) {}
+
+    uint64_t requests;
+    uint64_t hedges;     // requests sent to a second replica
+    uint64_t hedge_wins; // hedges answered before the first replica
+    uint64_t throttled;  // hedges not sent because of 'max_hedge_ratio'
+};
+
+// client for a primary and its replicas, which hedges reads against tail latency
+// a read-only command goes to the replicas in turn, and when its reply takes longer than the observed latency
+// percentile of its command type, it is sent again to the next replica - the reply which arrives first is taken,
+// and the other one is left to arrive late and be dropped by the next request on its connection
+// hedges are limited to 'max_hedge_ratio' of the requests (with bursts of 'max_hedge_burst'), so that a slow replica
+// can not double the load, and the other commands go to the primary without hedging
+// the two connections of a hedged request are waited on in turns of 'poll_interval'
+// thread-safety : safe in shared
+template<typename stream_type>
+class hedged_client
+{
+public:
+    typedef connection_pool<stream_type> pool_type;
+    typedef typename pool_type::connector_type connector_type;
+
+    struct options
+    {
+        options()
+            : connections_per_replica(4), wait_timeout(std::chrono::milliseconds(1000)), request_timeout(std::chrono::milliseconds(1000)),
+              hedge_percentile(0.95), min_samples(100), initial_hedge_delay(std::chrono::milliseconds(10)),
+              max_hedge_ratio(0.05), max_hedge_burst(10), poll_interval(std::chrono::milliseconds(1))
+        {
+        }
+
+        size_t connections_per_replica;
+        std::chrono::milliseconds wait_timeout;    // for a connection of the pool
+        std::chrono::milliseconds request_timeout; // error::timed_out after it, the connections are kept
+        double hedge_percentile;
+        size_t min_samples;                           // of a command type, before its percentile is trusted
+        std::chrono::microseconds initial_hedge_delay; // until then
+        double max_hedge_ratio;
+        size_t max_hedge_burst;
+        std::chrono::milliseconds poll_interval;
+    };
+
+    // 'replicas[0]' connects to the primary, which takes part in the reads as well
+    hedged_client(const std::vector<connector_type>& replicas, const options& opts = options())
+        : options_(opts), next_replica_(0), hedge_tokens_(0), requests_(0), hedges_(0), hedge_wins_(0), throttled_(0)
+    {
+        for (auto i = replicas.begin(), e = replicas.end(); i != e; ++i) {
+            typename pool_type::options pool_options;
+            pool_options.max_size = opts.connections_per_replica;
+            pool_options.wait_timeout = opts.wait_timeout;
+            pools_.emplace_back(new pool_type(*i, pool_options));
+        }
+    }
+
+    template<typename command_type>
+    std::error_code request(command_type& cmd)
+    {
+        return request(cmd, cmd.reply);
+    }
+
+    std::error_code request(const command& cmd, reply_handler& handler)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto& recorder = recorder_for(cmd);
+        requests_.fetch_add(1, std::memory_order_relaxed);
+
+        auto ec = cmd.is_read_only() && pools_.size() > 1 ?
+            hedged_request(cmd, handler, start, recorder.snapshot()) : primary_request(cmd, handler, start);
+
+        recorder.record(std::chrono::steady_clock::now() - start, ec && ec != redis::error::error_reply);
+        return ec;
+    }
+
+    // latency of the requests of the command type, hedging included
+    latency_stats stats(const command& cmd)
+    {
+        return recorder_for(cmd).snapshot();
+    }
+
+    hedge_stats hedging() const
+    {
+        hedge_stats result;
+        result.requests = requests_.load(std::memory_order_relaxed);
+        result.hedges = hedges_.load(std::memory_order_relaxed);
+        result.hedge_wins = hedge_wins_.load(std::memory_order_relaxed);
+        result.throttled = throttled_.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    size_t replica_count() const
+    {
+        return pools_.size();
+    }
+
+    pool_type& pool(size_t replica)
+    {
+        return *pools_[replica];
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    std::error_code primary_request(const command& cmd, reply_handler& handler, clock::time_point start)
+    {
+        auto connection = pools_[0]->checkout();
+        return connection ? connection->request_until(cmd, handler, start + options_.request_timeout) : redis::error::no_connection;
+    }
+
+    std::error_code hedged_request(const command& cmd, reply_handler& handler, clock::time_point start, const latency_stats& observed)
+    {
+        auto deadline = start + options_.request_timeout;
+        auto first = next_replica_.fetch_add(1, std::memory_order_relaxed) % pools_.size();
+        add_hedge_credit();
+
+        auto connection = pools_[first]->checkout();
+        if (!connection) {
+            return redis::error::no_connection;
+        }
+
+        auto ec = connection->send_request(cmd);
+        if (ec) {
+            return ec;
+        }
+
+        auto hedge_at = std::min(deadline, start + hedge_delay(observed));
+        ec = connection->receive_reply(handler, hedge_at);
+        if (ec != redis::error::timed_out || hedge_at >= deadline) {
+            return ec;
+        }
+        if (!take_hedge_token()) {
+            throttled_.fetch_add(1, std::memory_order_relaxed);
+            return connection->receive_reply(handler, deadline);
+        }
+
+        hedges_.fetch_add(1, std::memory_order_relaxed);
+        auto hedge = pools_[(first + 1) % pools_.size()]->checkout();
+        if (!hedge || hedge->send_request(cmd)) {
+            return connection->receive_reply(handler, deadline);
+        }
+
+        // whichever reply comes first - a replica which fails leaves the other one to wait for
+        session<stream_type>* attempts[] = { &*connection, &*hedge };
+        bool waiting[] = { true, true };
+
+        for (size_t turn = 0; waiting[0] || waiting[1]; turn ^= 1) {
+            if (!waiting[turn]) {
+                continue;
+            }
+
+            auto now = clock::now();
+            ec = attempts[turn]->receive_reply(handler, std::min(deadline, now + options_.poll_interval));
+            if (ec == redis::error::timed_out) {
+                if (now >= deadline) {
+                    break;
+                }
+                continue;
+            }
+
+            if (!ec || ec == redis::error::error_reply || ec == redis::error::handler_error) {
+                if (turn == 1) {
+                    hedge_wins_.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            }
+            waiting[turn] = false;
+        }
+        return ec;
+    }
+
+    clock::duration hedge_delay(const latency_stats& observed) const
+    {
+        if (observed.requests < options_.min_samples) {
+            return options_.initial_hedge_delay;
+        }
+        return observed.percentile(options_.hedge_percentile);
+    }
+
+    // token bucket in thousandths of a hedge - every request earns 'max_hedge_ratio' of one
+    void add_hedge_credit()
+    {
+        auto credit = static_cast<int64_t>(options_.max_hedge_ratio * 1000);
+        auto limit = static_cast<int64_t>(options_.max_hedge_burst) * 1000;
+
+        auto tokens = hedge_tokens_.load(std::memory_order_relaxed);
+        while (tokens < limit && !hedge_tokens_.compare_exchange_weak(tokens, std::min(tokens + credit, limit), std::memory_order_relaxed)) {
+        }
+    }
+
+    bool take_hedge_token()
+    {
+        auto tokens = hedge_tokens_.load(std::memory_order_relaxed);
+        while (tokens >= 1000) {
+            if (hedge_tokens_.compare_exchange_weak(tokens, tokens - 1000, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    latency_recorder& recorder_for(const command& cmd)
+    {
+        std::lock_guard<std::mutex> guard(recorders_lock_);
+        auto& recorder = recorders_[std::type_index(typeid(cmd))];
+        if (!recorder) {
+            recorder.reset(new latency_recorder());
+        }
+        return *recorder;
+    }
+
+    options options_;
+    std::vector<std::unique_ptr<pool_type>> pools_;
+
+    std::mutex recorders_lock_;
+    std::map<std::type_index, std::unique_ptr<latency_recorder>> recorders_;
+
+    std::atomic<size_t> next_replica_;
+    std::atomic<int64_t> hedge_tokens_;
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> hedges_;
+    std::atomic<uint64_t> hedge_wins_;
+    std::atomic<uint64_t> throttled_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_HEDGED_CLIENT_H
@@ -0,0 +1,105 @@
+#ifndef REDIS_LATENCY_STATS_H
+#define REDIS_LATENCY_STATS_H
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace redis
+{
+
+struct latency_stats
+{
+    // bucket i counts requests which took less than 2^i microseconds, the last one counts the rest
+    static const size_t bucket_count = 32;
+
+    latency_stats() : requests(0), errors(0), total_latency(0), max_latency(0)
+    {
+        buckets.fill(0);
+    }
+
+    std::chrono::nanoseconds mean_latency() const
+    {
+        return requests > 0 ? total_latency / static_cast<int64_t>(requests) : std::chrono::nanoseconds(0);
+    }
+
+    // upper bound of the latency of the given fraction (0.99 for p99) of the requests
+    std::chrono::microseconds percentile(double fraction) const
+    {
+        uint64_t target = static_cast<uint64_t>(fraction * requests);
+        uint64_t counted = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            counted += buckets[i];
+            if (counted > 0 && counted >= target) {
+                return std::chrono::microseconds(static_cast<int64_t>(1) << i);
+            }
+        }
+        return std::chrono::microseconds(0);
+    }
+
+    uint64_t requests;
+    uint64_t errors;
+    std::chrono::nanoseconds total_latency;
+    std::chrono::nanoseconds max_latency;
+    std::array<uint64_t, bucket_count> buckets;
+};
+
+// latency histogram updated by many threads at once
+// thread-safety : safe in shared
+class latency_recorder
+{
+public:
+    latency_recorder() : requests_(0), errors_(0), total_nanoseconds_(0), max_nanoseconds_(0)
+    {
+        for (auto& b : buckets_) {
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(std::chrono::steady_clock::duration latency, bool failed)
+    {
+        auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        if (failed) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+        }
+        total_nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        auto max = max_nanoseconds_.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !max_nanoseconds_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+        }
+
+        size_t bucket = 0;
+        for (auto microseconds = nanoseconds / 1000; microseconds > 0 && bucket + 1 < latency_stats::bucket_count; microseconds >>= 1) {
+            bucket++;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    latency_stats snapshot() const
+    {
+        latency_stats result;
+        result.requests = requests_.load(std::memory_order_relaxed);
+        result.errors = errors_.load(std::memory_order_relaxed);
+        result.total_latency = std::chrono::nanoseconds(total_nanoseconds_.load(std::memory_order_relaxed));
+        result.max_latency = std::chrono::nanoseconds(max_nanoseconds_.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < latency_stats::bucket_count; i++) {
+            result.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> errors_;
+    std::atomic<uint64_t> total_nanoseconds_;
+    std::atomic<uint64_t> max_nanoseconds_;
+    std::array<std::atomic<uint64_t>, latency_stats::bucket_count> buckets_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_LATENCY_STATS_H
@@ -0,0 +1,62 @@
+#ifndef REDIS_MASS_LOADER_H
+#define REDIS_MASS_LOADER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <system_error>
+
+#include "redis_base.h"
+
+namespace redis
+{
+
+// what a mass_loader run did
+struct load_stats
+{
+    load_stats() : commands(0), replies(0), bytes(0), errors(0), max_in_flight(0), elapsed(0), max_lag(0) {}
+
+    double commands_per_second() const
+    {
+        auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+        return seconds > 0 ? replies / seconds : 0;
+    }
+
+    size_t commands;    // commands written
+    size_t replies;     // replies read, including error replies
+    size_t bytes;       // bytes of the commands written
+    size_t errors;      // error replies
+    size_t max_in_flight;
+
+    std::vector<std::string> error_samples; // the first error replies, up to mass_loader::max_error_samples
+
+    std::chrono::steady_clock::duration elapsed;
+    std::chrono::steady_clock::duration max_lag; // the longest time between writing a command and reading its reply
+};
+
+// sends a long sequence of commands with a bounded window of unanswered commands, like 'redis-cli --pipe'
+// commands are written while earlier replies are still arriving, and the replies are only counted,
+// with error replies collected, instead of being parsed into per-command handlers
+// the window should be smaller than what the transport buffers in each direction, or both sides may block on writing
+// the bytes are counted as the source writes them, so the limits also apply to streams which flush on their own
+// thread-safety : safe in distinct, not safe in shared
+struct mass_loader
+{
+    // writes the next command into the output, typically with format_command, and returns false when no command is left
+    typedef std::function<bool(stream& output)> source_type;
+
+    mass_loader() : max_in_flight_commands(10000), max_in_flight_bytes(1 << 20), flush_size(1 << 16), max_error_samples(16) {}
+
+    // returns an empty error code once every command written is answered, even if some replies are errors
+    std::error_code load(stream& connection, const source_type& source, load_stats& stats) const;
+
+    size_t max_in_flight_commands;
+    size_t max_in_flight_bytes;
+    size_t flush_size;          // written commands are flushed once this many bytes are buffered
+    size_t max_error_samples;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_MASS_LOADER_H
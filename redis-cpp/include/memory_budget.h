@@ -0,0 +1,57 @@
+#ifndef REDIS_MEMORY_BUDGET_H
+#define REDIS_MEMORY_BUDGET_H
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+namespace redis
+{
+
+// upper bound of the buffer memory shared by a set of connections
+// a connection acquires bytes before growing a buffer and releases them when the buffer shrinks or the connection closes
+// callers either try and get a try-again result, or block until other connections release enough bytes
+// thread-safety : safe in shared
+class memory_budget
+{
+public:
+    explicit memory_budget(size_t limit);
+
+    memory_budget(const memory_budget&) = delete;
+    memory_budget& operator=(const memory_budget&) = delete;
+
+    // returns false at once when 'n' bytes do not fit in the budget now
+    bool try_acquire(size_t n);
+
+    // waits up to 'timeout' for 'n' bytes to fit in the budget
+    // a request larger than the whole budget fails at once
+    bool acquire(size_t n, std::chrono::milliseconds timeout);
+
+    void release(size_t n);
+
+    size_t limit() const
+    {
+        return limit_;
+    }
+
+    size_t used() const;
+
+    // acquisitions which had to wait, and the ones which failed by time out or size
+    uint64_t waits() const;
+    uint64_t rejections() const;
+
+private:
+    const size_t limit_;
+    size_t used_;
+    uint64_t waits_;
+    uint64_t rejections_;
+
+    mutable std::mutex lock_;
+    std::condition_variable released_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_MEMORY_BUDGET_H
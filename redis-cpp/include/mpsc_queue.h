@@ -0,0 +1,56 @@
+#ifndef REDIS_MPSC_QUEUE_H
+#define REDIS_MPSC_QUEUE_H
+
+#include <atomic>
+
+namespace redis
+{
+
+// lock-free intrusive multi-producer single-consumer queue
+// producers push nodes one by one, the consumer takes every queued node at once in FIFO order
+// node_type should have a 'node_type* next' member, and nodes should outlive their stay in the queue
+// thread-safety : push is safe in shared, pop_all should be called from a single consumer thread
+template<typename node_type>
+class mpsc_queue
+{
+public:
+    mpsc_queue() : head_(nullptr) {}
+
+    // returns true if the queue was empty, so that the producer knows whether the consumer may need a wake-up
+    bool push(node_type* node)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while (!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+        return head == nullptr;
+    }
+
+    // returns the queued nodes linked in FIFO order, or nullptr
+    node_type* pop_all()
+    {
+        auto node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // nodes are pushed onto a stack, so reverse them
+        node_type* reversed = nullptr;
+        while (node != nullptr) {
+            auto next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+        return reversed;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    std::atomic<node_type*> head_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_MPSC_QUEUE_H
@@ -0,0 +1,168 @@
+#ifndef REDIS_MULTIPLEXED_SESSION_H
+#define REDIS_MULTIPLEXED_SESSION_H
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <utility>
+#include <system_error>
+
+#include "redis_base.h"
+#include "mpsc_queue.h"
+
+namespace redis
+{
+
+// a connection shared by many threads
+// requests are queued on a lock-free queue, and a single I/O thread sends whatever is queued with one flush
+// and matches the replies back to the requests in FIFO order
+// the command and the handler of a request should stay alive until its future is ready
+// thread-safety : safe in shared, except that connect and close should not race with request
+template<typename stream_type>
+class multiplexed_session
+{
+public:
+    multiplexed_session() : running_(false), sleeping_(false) {}
+
+    ~multiplexed_session()
+    {
+        close();
+    }
+
+    // connects the underlying stream with the arguments of stream_type::connect, and starts the I/O thread
+    template<typename... Args>
+    bool connect(Args&&... args)
+    {
+        if (running_.load() || !session_.connect(std::forward<Args>(args)...)) {
+            return false;
+        }
+
+        running_.store(true);
+        io_thread_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    // serves the requests queued so far, then stops the I/O thread and closes the stream
+    void close()
+    {
+        if (!io_thread_.joinable()) {
+            return;
+        }
+
+        running_.store(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_up_.notify_one();
+        }
+        io_thread_.join();
+        session_.close();
+    }
+
+    bool is_open() const
+    {
+        return running_.load();
+    }
+
+    template<typename command_type>
+    std::future<std::error_code> request(command_type& cmd)
+    {
+        return request(cmd, cmd.reply);
+    }
+
+    std::future<std::error_code> request(const command& cmd, reply_handler& handler)
+    {
+        auto node = new request_node(cmd, handler);
+        auto result = node->done.get_future();
+
+        if (!running_.load()) {
+            node->done.set_value(redis::error::stream_not_initialized);
+            delete node;
+            return result;
+        }
+
+        queue_.push(node);
+        wake();
+        return result;
+    }
+
+private:
+    struct request_node
+    {
+        request_node(const command& cmd, reply_handler& handler) : cmd(&cmd), handler(&handler), next(nullptr) {}
+
+        const command* cmd;
+        reply_handler* handler;
+        std::promise<std::error_code> done;
+        request_node* next;
+    };
+
+    void run()
+    {
+        command_pipeline batch;
+        std::vector<request_node*> nodes;
+
+        for (;;) {
+            auto node = queue_.pop_all();
+            if (node == nullptr) {
+                if (!running_.load()) {
+                    break;
+                }
+                wait();
+                continue;
+            }
+
+            // everything queued while the previous batch was in flight goes out with a single flush
+            batch.clear();
+            nodes.clear();
+            for (; node != nullptr; node = node->next) {
+                batch.add(*node->cmd, *node->handler);
+                nodes.push_back(node);
+            }
+
+            session_.pipeline(batch);
+
+            for (size_t i = 0; i < nodes.size(); i++) {
+                nodes[i]->done.set_value(batch.result(i));
+                delete nodes[i];
+            }
+        }
+    }
+
+    // the I/O thread announces that it is going to sleep, and producers only take the lock when it does
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleeping_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (queue_.empty() && running_.load()) {
+            wake_up_.wait(lock);
+        }
+        sleeping_.store(false);
+    }
+
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_up_.notify_one();
+        }
+    }
+
+    session<stream_type> session_;
+    mpsc_queue<request_node> queue_;
+
+    std::thread io_thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> sleeping_;
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_MULTIPLEXED_SESSION_H
@@ -0,0 +1,277 @@
+#ifndef REDIS_PARSER_H
+#define REDIS_PARSER_H
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "finally.h"
+#include "error.h"
+
+namespace redis
+{
+
+namespace detail
+{
+
+using std::begin;
+using std::end;
+
+// calls handler functions through the static type of the handler, so that parsing into a concrete handler
+// does not go through the vtable - abstract handler types are called virtually as usual
+template<typename handler_type, bool is_abstract = std::is_abstract<handler_type>::value>
+struct handler_dispatch
+{
+    static bool on_status(handler_type& h, const_buffer_view data) { return h.handler_type::on_status(data); }
+    static bool on_error(handler_type& h, const_buffer_view data) { return h.handler_type::on_error(data); }
+    static bool on_integer(handler_type& h, int64_t value) { return h.handler_type::on_integer(value); }
+    static bool on_null(handler_type& h) { return h.handler_type::on_null(); }
+    static bool on_bulk(handler_type& h, const_buffer_view data) { return h.handler_type::on_bulk(data); }
+    static bool on_multi_bulk_begin(handler_type& h, size_t count) { return h.handler_type::on_multi_bulk_begin(count); }
+    static bool on_enter_reply(handler_type& h, size_t depth) { return h.handler_type::on_enter_reply(depth); }
+    static bool on_leave_reply(handler_type& h, size_t depth) { return h.handler_type::on_leave_reply(depth); }
+    static buffer_view on_bulk_buffer(handler_type& h, size_t size) { return h.handler_type::on_bulk_buffer(size); }
+};
+
+template<typename handler_type>
+struct handler_dispatch<handler_type, true>
+{
+    static bool on_status(handler_type& h, const_buffer_view data) { return h.on_status(data); }
+    static bool on_error(handler_type& h, const_buffer_view data) { return h.on_error(data); }
+    static bool on_integer(handler_type& h, int64_t value) { return h.on_integer(value); }
+    static bool on_null(handler_type& h) { return h.on_null(); }
+    static bool on_bulk(handler_type& h, const_buffer_view data) { return h.on_bulk(data); }
+    static bool on_multi_bulk_begin(handler_type& h, size_t count) { return h.on_multi_bulk_begin(count); }
+    static bool on_enter_reply(handler_type& h, size_t depth) { return h.on_enter_reply(depth); }
+    static bool on_leave_reply(handler_type& h, size_t depth) { return h.on_leave_reply(depth); }
+    static buffer_view on_bulk_buffer(handler_type& h, size_t size) { return h.on_bulk_buffer(size); }
+};
+
+// synchronous parser routines
+// currently, asynchronous input stream is not considered - every stream implementation should return full data expected in the request
+template<typename handler_type>
+class basic_parser
+{
+public:
+    basic_parser(stream& input, handler_type& handler)
+        : input(input), handler(handler), recursion_depth(0), handler_error(false), reply_error(false)
+    {
+    }
+
+    template<typename... Params, typename... Args>
+    void handle(bool (*f)(handler_type&, Params...), Args&&... args)
+    {
+        if (!handler_error && !f(handler, std::forward<Args>(args)...)) {
+            handler_error = true;
+            err = error::handler_error;
+        }
+    }
+
+    template<typename char_iterator>
+    bool read_integer(char_iterator i, char_iterator e, int64_t& output)
+    {
+        int32_t value = 0;
+        auto signedness = 1;
+
+        if (*i == '-') {
+            signedness = -1;
+            ++i;
+        } else if (*i == '+') {
+            ++i;
+        }
+
+        for (; i != e; ++i) {
+            auto decimal = *i - '0';
+            if (decimal >= 0 && decimal < 10) {
+                value *= 10;
+                value += decimal;
+            } else {
+                err = error::ill_formed_reply;
+                return false;
+            }
+        }
+
+        output = signedness * value;
+        return true;
+    }
+
+    bool read_crlf()
+    {
+        // Don't need to check crlf, just skip 2 byte
+        auto result = input.skip(sizeof(crlf));
+        if (result != sizeof(crlf)) {
+            err = error::stream_error;
+            return false;
+        }
+        return true;
+    }
+
+    template<typename functor>
+    bool read_line(functor func)
+    {
+        size_t msg_size = 64; // There's no message reply over 64 byte in redis currently...
+
+        for (;;) { // Though we should handle arbitrary sized message
+            auto buffer = input.peek(msg_size);
+            if (!buffer.valid()) {
+                err = error::stream_error;
+                return false;
+            }
+            auto search_result = std::search(begin(buffer), end(buffer), begin(crlf), end(crlf));
+
+            if (search_result != end(buffer)) {
+                auto line_data = buffer.slice(0, search_result - begin(buffer));
+                if (!func(line_data)) {
+                    return false;
+                }
+                input.skip(search_result - begin(buffer));		
+                return read_crlf();
+            } else if (buffer.size() == msg_size) { // If 64 byte is not enough
+                msg_size *= 2; // Try once more with doubled buffer
+            } else {
+                err = error::stream_error;
+                return false;
+            }
+        }		
+    }
+
+    bool read_bulk()
+    {
+        int64_t expected_size = 0;
+        auto result = read_line([&](const const_buffer_view& buffer) {
+            return read_integer(begin(buffer), end(buffer), expected_size);
+        });
+
+        if (!result) {
+            return false;
+        }
+
+        if (expected_size < 0) {
+            handle(&dispatch::on_null);
+            return true;
+        }
+
+        auto size = static_cast<size_t>(expected_size);
+        auto target = (size > 0 && !handler_error) ? dispatch::on_bulk_buffer(handler, size) : buffer_view();
+
+        if (target.valid() && target.size() == size) {
+            // zero-copy path : the handler owns the destination of the bulk data
+            if (!input.read_into(target)) {
+                err = error::stream_error;
+                return false;
+            }
+            handle(&dispatch::on_bulk, const_buffer_view(target));
+        } else {
+            auto buffer = input.read(size);
+            if (!buffer.valid() || buffer.size() != size) {
+                err = error::stream_error;
+                return false;
+            }
+            handle(&dispatch::on_bulk, buffer);
+        }
+        return read_crlf();
+    }
+
+    bool read_multi_bulk()
+    {
+        int64_t expected_bulk_count = 0;
+        auto result = read_line([&](const const_buffer_view& buffer) {
+            return read_integer(begin(buffer), end(buffer), expected_bulk_count);
+        });
+
+        if (!result) {
+            return false;
+        }
+
+        handle(&dispatch::on_multi_bulk_begin, static_cast<size_t>(expected_bulk_count));
+
+        for (int i = 0; i < expected_bulk_count; i++) {
+            if (!parse_one_reply()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool parse_one_reply()
+    {
+        char type;
+        if (!input.read(type)) {
+            err = error::stream_error;
+            return false;
+        }
+
+        handle(&dispatch::on_enter_reply, recursion_depth++);
+        auto on_leave = finally([this] {
+            handle(&dispatch::on_leave_reply, --recursion_depth);
+        });
+
+        switch(type)
+        {
+        case '+': // Single line reply
+            return read_line([this](const const_buffer_view& buffer) -> bool {
+                handle(&dispatch::on_status, buffer);
+                return true;
+            });
+        case '-': // Error message
+            reply_error = true;
+            err = error::error_reply;
+            return read_line([this](const const_buffer_view& buffer) -> bool {
+                handle(&dispatch::on_error, buffer);
+                return true;
+            });
+        case ':': // Integer number
+            return read_line([this](const const_buffer_view& buffer) -> bool {
+                int64_t value = 0;
+                if (!read_integer(begin(buffer), end(buffer), value)) {
+                    return false;
+                }
+                handle(&dispatch::on_integer, value);
+                return true;
+            });
+        case '$': // Bulk reply
+            return read_bulk();
+        case '*': // Multi-bulk reply
+            return read_multi_bulk();
+        default : // Ill-formed reply
+            err = error::ill_formed_reply;
+            return false;
+        }
+    }
+
+    bool parse()
+    {
+        return parse_one_reply() && !handler_error && !reply_error;
+    }
+
+    typedef handler_dispatch<handler_type> dispatch;
+
+    stream& input;
+    handler_type& handler;
+    size_t recursion_depth;
+    std::error_code err;
+    bool handler_error;
+    bool reply_error;
+};
+
+} // namespace "redis::detail"
+
+// parses a reply into a handler of a statically known type without virtual calls
+// the dynamic type of the handler should be handler_type itself, e.g. the reply member of a command
+template<typename handler_type>
+std::error_code parse_typed(stream& input, handler_type& handler)
+{
+    detail::basic_parser<handler_type> p(input, handler);
+
+    if (p.parse()) {
+        return std::error_code();
+    } else {
+        return p.err;
+    }
+}
+
+} // namespace "redis"
+
+#endif // REDIS_PARSER_H
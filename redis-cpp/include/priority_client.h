@@ -0,0 +1,121 @@
+#ifndef REDIS_PRIORITY_CLIENT_H
+#define REDIS_PRIORITY_CLIENT_H
+
+#include <memory>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "connection_pool.h"
+#include "latency_stats.h"
+
+namespace redis
+{
+
+enum lane_type
+{
+    interactive_lane,
+    bulk_lane,
+    lane_count
+};
+
+// 'errors' counts requests which got no connection, or failed in the stream - error replies are not counted
+// 'total_latency' includes the wait for a connection of the lane
+typedef latency_stats lane_stats;
+
+// client with a separate set of connections per lane, so that latency-critical commands never queue behind large replies
+// commands go to the lane given by the caller, or to the bulk lane when their reply_size_hint is above 'bulk_threshold'
+// the hint counts reply elements, not bytes - a GET of a large value counts as one, so give such commands the bulk lane
+// connections of the interactive lane are reserved for it - bulk traffic waits for its own lane instead
+// thread-safety : safe in shared
+template<typename stream_type>
+class priority_client
+{
+public:
+    typedef connection_pool<stream_type> pool_type;
+    typedef typename pool_type::connector_type connector_type;
+
+    struct options
+    {
+        options() : interactive_connections(4), bulk_connections(2), bulk_threshold(1000), wait_timeout(std::chrono::milliseconds(1000)) {}
+
+        size_t interactive_connections;
+        size_t bulk_connections;
+        size_t bulk_threshold; // in reply elements
+        std::chrono::milliseconds wait_timeout;
+    };
+
+    priority_client(connector_type connector, const options& opts = options())
+        : options_(opts)
+    {
+        for (size_t i = 0; i < lane_count; i++) {
+            typename pool_type::options pool_options;
+            pool_options.max_size = i == interactive_lane ? opts.interactive_connections : opts.bulk_connections;
+            pool_options.wait_timeout = opts.wait_timeout;
+            lanes_[i].pool.reset(new pool_type(connector, pool_options));
+        }
+    }
+
+    lane_type classify(const command& cmd) const
+    {
+        return cmd.reply_size_hint() > options_.bulk_threshold ? bulk_lane : interactive_lane;
+    }
+
+    template<typename command_type>
+    std::error_code request(command_type& cmd)
+    {
+        return request(cmd, cmd.reply, classify(cmd));
+    }
+
+    template<typename command_type>
+    std::error_code request(command_type& cmd, lane_type lane)
+    {
+        return request(cmd, cmd.reply, lane);
+    }
+
+    std::error_code request(const command& cmd, reply_handler& handler, lane_type lane)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        std::error_code ec;
+        {
+            auto connection = lanes_[lane].pool->checkout();
+            ec = connection ? send_and_receive(*connection, cmd, handler) : redis::error::no_connection;
+        }
+
+        lanes_[lane].recorder.record(std::chrono::steady_clock::now() - start, ec && ec != redis::error::error_reply);
+        return ec;
+    }
+
+    lane_stats stats(lane_type lane) const
+    {
+        return lanes_[lane].recorder.snapshot();
+    }
+
+    pool_type& pool(lane_type lane)
+    {
+        return *lanes_[lane].pool;
+    }
+
+private:
+    // unlike session::request, an error reply keeps the pooled connection instead of reconnecting it
+    static std::error_code send_and_receive(session<stream_type>& connection, const command& cmd, reply_handler& handler)
+    {
+        auto ec = connection.send_request(cmd);
+        return ec ? ec : connection.receive_reply(handler);
+    }
+
+    struct lane
+    {
+        std::unique_ptr<pool_type> pool;
+        latency_recorder recorder;
+    };
+
+    options options_;
+    lane lanes_[lane_count];
+};
+
+} // namespace "redis"
+
+#endif // REDIS_PRIORITY_CLIENT_H
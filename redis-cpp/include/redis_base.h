@@ -2,6 +2,11 @@
 #define REDIS_BASE_H
 
 #include <cstdint>
+#include <array>
+#include <chrono>
+#include <tuple>
+#include <vector>
+#include <utility>
 #include <type_traits>
 #include <system_error>
 
@@ -17,6 +22,15 @@ typedef array_view<char> buffer_view;
 typedef array_view<const char> const_buffer_view;
 
 
+// a region of an opened file, written to the stream as its raw content
+struct file_region
+{
+    int fd;
+    int64_t offset;
+    size_t length;
+};
+
+
 struct stream
 {
     virtual ~stream() {}
@@ -31,11 +45,45 @@ struct stream
     virtual const_buffer_view read(size_t n) = 0;
     virtual size_t skip(size_t n) = 0;
 
+    // reads exactly output.size() bytes into caller-owned memory
+    // default implementation copies them out of read(), stream implementations can override it to receive in place
+    virtual bool read_into(buffer_view output)
+    {
+        if (output.empty()) {
+            return true;
+        }
+        auto result = read(output.size());
+        if (!result.valid() || result.size() != output.size()) {
+            return false;
+        }
+        std::copy(begin(result), end(result), begin(output));
+        return true;
+    }
+
     // interface for stream output
     virtual bool flush() = 0;
 
     virtual bool write(const_buffer_view input) = 0;
 
+    // writes the content of the file region, keeping its order with the other output
+    // default implementation reads the file through write(), stream implementations can override it
+    // to send the region from the page cache at flush time - the file should not be closed until then
+    virtual bool write_file(const file_region& region);
+
+    // size of the output written but not flushed yet - zero if the stream does not track it
+    virtual size_t pending_output() const
+    {
+        return 0;
+    }
+
+    // waits up to 'timeout' until more input can be read without blocking, returns false if none arrived in time
+    // returning true without more input means the stream was closed by the peer or failed
+    // default implementation can not wait, so that deadlines only cover the input which is already buffered
+    virtual bool wait_readable(std::chrono::milliseconds)
+    {
+        return false;
+    }
+
     // utility member functions
     template<typename T>
     bool read(T& value) {
@@ -57,6 +105,9 @@ struct stream
 };
 
 
+// reply_size_hint of commands which may reply with a whole collection
+const size_t unbounded_reply_size = static_cast<size_t>(-1);
+
 struct command
 {
     virtual std::error_code write_command(stream& output) const = 0;
@@ -64,6 +115,18 @@ struct command
     // to prepare cluster use
     virtual const_buffer_view cluster_key() const = 0;
     virtual bool is_subscriber_cmd() const = 0;
+
+    // rough number of elements in the reply, so that clients can tell large replies apart before sending
+    virtual size_t reply_size_hint() const
+    {
+        return 1;
+    }
+
+    // true for commands which do not modify the data, so that clients may send them to a replica or send them twice
+    virtual bool is_read_only() const
+    {
+        return false;
+    }
 };
 
 
@@ -83,19 +146,108 @@ public:
 
     virtual bool on_enter_reply(size_t recursion_depth) = 0;
     virtual bool on_leave_reply(size_t recursion_depth) = 0;
+
+    // optional hook called before non-empty bulk data is read
+    // returning a valid buffer of exactly 'size' bytes makes the parser receive the bulk data directly into it,
+    // and on_bulk is then called with a view on that buffer
+    virtual buffer_view on_bulk_buffer(size_t size)
+    {
+        return buffer_view();
+    }
 };
 
 // reply parse function
 std::error_code parse(stream& input, reply_handler& handler);
 
+// reply parse function for a statically known handler type - defined in parser.h
+template<typename handler_type>
+std::error_code parse_typed(stream& input, handler_type& handler);
+
+// waits until a whole reply is buffered in the input without consuming it, and returns its size in 'reply_size'
+// returns error::timed_out once 'deadline' passes - the input is left as it was, so that the wait can be repeated
+std::error_code wait_reply(stream& input, std::chrono::steady_clock::time_point deadline, size_t& reply_size);
+
+// reads a reply and drops it
+std::error_code skip_reply(stream& input);
+
+
+// commands sent together through session::pipeline, whose replies are parsed in order
+struct command_pipeline
+{
+    struct entry
+    {
+        const command* cmd;
+        reply_handler* handler;
+        std::error_code result;
+    };
+
+    command_pipeline() : max_buffered(1 << 20) {}
+
+    template<typename command_type>
+    command_pipeline& add(command_type& cmd)
+    {
+        return add(cmd, cmd.reply);
+    }
+
+    command_pipeline& add(const command& cmd, reply_handler& handler)
+    {
+        entry e = { &cmd, &handler, std::error_code() };
+        entries.push_back(e);
+        return *this;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    const std::error_code& result(size_t index) const
+    {
+        return entries[index].result;
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+    std::vector<entry> entries;
+
+    // once this many bytes are buffered, the commands written so far are flushed and their replies are parsed
+    // before writing more - it only takes effect on streams which track pending_output
+    size_t max_buffered;
+};
+
+
+// result of a compile-time typed pipeline
+template<typename... reply_types>
+struct typed_pipeline_result
+{
+    template<typename... reply_args>
+    typed_pipeline_result(std::error_code error, const std::array<std::error_code, sizeof...(reply_types)>& results, reply_args&&... replies)
+        : error(error), results(results), replies(std::forward<reply_args>(replies)...)
+    {
+    }
+
+    std::error_code error; // the first error in the pipeline
+    std::array<std::error_code, sizeof...(reply_types)> results;
+    std::tuple<reply_types...> replies;
+};
+
 
 // thread-safety : safe in distinct, not safe in shared
 template<typename stream_type>
 struct session : public stream_type
 {
-    session() {}
+    session() : late_replies_(0) {}
     ~session() {}
 
+    virtual bool close() override
+    {
+        late_replies_ = 0;
+        return stream_type::close();
+    }
+
     template<typename command_type>
     std::error_code request(command_type& cmd)
     {
@@ -112,6 +264,57 @@ struct session : public stream_type
             return redis::error::subscriber_cmd_error;
         }
 
+        auto ec = skip_late_replies();
+        if (ec) {
+            return ec;
+        }
+
+        ec = cmd.write_command(*this);
+        if (ec) {
+            return close() ? redis::error::stream_error : ec;
+        }
+
+        if (!flush()) {
+            close();
+            return redis::error::stream_error;
+        }
+
+        ec = redis::parse(*this, handler);
+        if (ec) {
+            return close() ? redis::error::stream_error : ec;
+        }
+
+        return std::error_code();
+    }
+
+    // request which gives up waiting for the reply at 'deadline' and returns error::timed_out, keeping the connection
+    // the late reply is read and dropped by the next request on the session, instead of reconnecting
+    // the wait only takes effect on streams which implement wait_readable
+    template<typename command_type>
+    std::error_code request_until(command_type& cmd, std::chrono::steady_clock::time_point deadline)
+    {
+        return request_until(cmd, cmd.reply, deadline);
+    }
+
+    std::error_code request_until(const command& cmd, reply_handler& handler, std::chrono::steady_clock::time_point deadline)
+    {
+        auto ec = send_request(cmd);
+        return ec ? ec : receive_reply(handler, deadline);
+    }
+
+    // the halves of request_until, for a caller waiting on several sessions at once
+    // send_request leaves the reply owed as a late reply until receive_reply takes it, the replies of the requests given
+    // up before go first - a reply never received is dropped by the next request
+    std::error_code send_request(const command& cmd)
+    {
+        if (!is_open()) {
+            return redis::error::stream_not_initialized;
+        }
+
+        if (cmd.is_subscriber_cmd()) {
+            return redis::error::subscriber_cmd_error;
+        }
+
         auto ec = cmd.write_command(*this);
         if (ec) {
             return close() ? redis::error::stream_error : ec;
@@ -122,15 +325,271 @@ struct session : public stream_type
             return redis::error::stream_error;
         }
 
+        late_replies_++;
+        return std::error_code();
+    }
+
+    // receives the reply of the last request sent, once the earlier late replies are dropped
+    std::error_code receive_reply(reply_handler& handler, std::chrono::steady_clock::time_point deadline)
+    {
+        if (!is_open()) {
+            return redis::error::stream_not_initialized;
+        }
+        if (late_replies_ == 0) {
+            return redis::error::no_pending_request; // a misuse, the stream is left as it is
+        }
+
+        auto ec = skip_late_replies(deadline, 1);
+        if (ec) {
+            return ec;
+        }
+
+        size_t reply_size = 0;
+        ec = redis::wait_reply(*this, deadline, reply_size);
+        if (ec == redis::error::timed_out) {
+            return ec;
+        }
+        if (ec) {
+            return close() ? redis::error::stream_error : ec;
+        }
+
+        // the whole reply is buffered, so parsing does not block
+        late_replies_--;
         ec = redis::parse(*this, handler);
+        if (ec && ec != redis::error::error_reply && ec != redis::error::handler_error) {
+            return close() ? redis::error::stream_error : ec;
+        }
+        return ec;
+    }
+
+    // receives the reply of the last request sent without a deadline, blocking as request does
+    // unlike request, error replies and handler errors keep the connection, for callers which reuse it
+    std::error_code receive_reply(reply_handler& handler)
+    {
+        if (!is_open()) {
+            return redis::error::stream_not_initialized;
+        }
+        if (late_replies_ == 0) {
+            return redis::error::no_pending_request;
+        }
+
+        auto ec = skip_late_replies(1);
         if (ec) {
+            return ec;
+        }
+
+        late_replies_--;
+        ec = redis::parse(*this, handler);
+        if (ec && ec != redis::error::error_reply && ec != redis::error::handler_error) {
             return close() ? redis::error::stream_error : ec;
         }
+        return ec;
+    }
+
+    template<typename command_type, typename Rep, typename Period>
+    std::error_code request_for(command_type& cmd, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return request_until(cmd, cmd.reply, std::chrono::steady_clock::now() + timeout);
+    }
+
+    template<typename Rep, typename Period>
+    std::error_code request_for(const command& cmd, reply_handler& handler, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return request_until(cmd, handler, std::chrono::steady_clock::now() + timeout);
+    }
+
+    // number of replies still to arrive for requests which timed out
+    size_t late_replies() const
+    {
+        return late_replies_;
+    }
+
+    // sends every command of the batch with as few flushes as possible and parses the replies into their handlers
+    // error replies and handler errors are reported per command without closing the stream
+    // returns the first error in the batch, or an empty error code if every command succeeded
+    std::error_code pipeline(command_pipeline& batch)
+    {
+        if (!is_open()) {
+            return abort_pipeline(batch, 0, redis::error::stream_not_initialized);
+        }
 
+        auto late = skip_late_replies();
+        if (late) {
+            return abort_pipeline(batch, 0, late);
+        }
+
+        auto& entries = batch.entries;
+        for (auto i = entries.begin(), e = entries.end(); i != e; ++i) {
+            i->result = std::error_code();
+        }
+
+        size_t written = 0;
+        size_t parsed = 0;
+
+        while (parsed < entries.size()) {
+            // write at least one command per round, and stop at the buffer cap
+            while (written < entries.size() && (written == parsed || this->pending_output() < batch.max_buffered)) {
+                auto& entry = entries[written++];
+                if (entry.cmd->is_subscriber_cmd()) {
+                    entry.result = redis::error::subscriber_cmd_error;
+                    continue;
+                }
+
+                auto ec = entry.cmd->write_command(*this);
+                if (ec) {
+                    return abort_pipeline(batch, parsed, close() ? redis::error::stream_error : ec);
+                }
+            }
+
+            if (!flush()) {
+                close();
+                return abort_pipeline(batch, parsed, redis::error::stream_error);
+            }
+
+            for (; parsed < written; ++parsed) {
+                auto& entry = entries[parsed];
+                if (entry.result) { // not sent
+                    continue;
+                }
+
+                entry.result = redis::parse(*this, *entry.handler);
+                if (entry.result && entry.result != redis::error::error_reply && entry.result != redis::error::handler_error) {
+                    // the rest of the stream can not be trusted anymore
+                    return abort_pipeline(batch, parsed, close() ? redis::error::stream_error : entry.result);
+                }
+            }
+        }
+
+        for (auto i = entries.begin(), e = entries.end(); i != e; ++i) {
+            if (i->result) {
+                return i->result;
+            }
+        }
+        return std::error_code();
+    }
+
+    // compile-time typed pipeline : session.pipeline(get, incr, hgetall)
+    // every reply is parsed with its statically known handler type, and the replies are returned in a tuple
+    // replies of rvalue commands are moved out of them, the others are copied
+    template<typename... command_types>
+    typed_pipeline_result<typename std::decay<decltype(std::declval<command_types&>().reply)>::type...>
+        pipeline(command_types&&... cmds)
+    {
+        return typed_pipeline(std::index_sequence_for<command_types...>(), std::forward<command_types>(cmds)...);
+    }
+
+private:
+    template<size_t... indexes, typename... command_types>
+    typed_pipeline_result<typename std::decay<decltype(std::declval<command_types&>().reply)>::type...>
+        typed_pipeline(std::index_sequence<indexes...>, command_types&&... cmds)
+    {
+        const command* commands[] = { static_cast<const command*>(&cmds)..., nullptr };
+        std::array<std::error_code, sizeof...(command_types)> results;
+        bool broken = !is_open();
+
+        if (broken) {
+            results.fill(redis::error::stream_not_initialized);
+        } else {
+            auto late = skip_late_replies();
+            if (late) {
+                broken = true;
+                results.fill(late);
+            }
+        }
+
+        for (size_t i = 0; i < results.size() && !broken; i++) {
+            if (commands[i]->is_subscriber_cmd()) {
+                results[i] = redis::error::subscriber_cmd_error;
+                continue;
+            }
+
+            auto ec = commands[i]->write_command(*this);
+            if (ec) {
+                broken = true;
+                results.fill(close() ? redis::error::stream_error : ec);
+            }
+        }
+
+        if (!broken && !flush()) {
+            broken = true;
+            close();
+            results.fill(redis::error::stream_error);
+        }
+
+        // parse in order - braced initializer lists are evaluated from left to right
+        int expand[] = { 0, (parse_pipelined(results[indexes], broken, cmds.reply), 0)... };
+        (void)expand;
+
+        std::error_code first_error;
+        for (size_t i = 0; i < results.size() && !first_error; i++) {
+            first_error = results[i];
+        }
+
+        return typed_pipeline_result<typename std::decay<decltype(cmds.reply)>::type...>(
+            first_error, results, std::forward<command_types>(cmds).reply...);
+    }
+
+    template<typename handler_type>
+    void parse_pipelined(std::error_code& result, bool& broken, handler_type& handler)
+    {
+        if (broken) {
+            if (!result) {
+                result = redis::error::stream_error;
+            }
+            return;
+        }
+        if (result) { // not sent
+            return;
+        }
+
+        result = redis::parse_typed(*this, handler);
+        if (result && result != redis::error::error_reply && result != redis::error::handler_error) {
+            broken = true;
+            result = close() ? redis::error::stream_error : result;
+        }
+    }
+
+    std::error_code skip_late_replies(size_t keep = 0)
+    {
+        for (; late_replies_ > keep; late_replies_--) {
+            auto ec = redis::skip_reply(*this);
+            if (ec && ec != redis::error::error_reply) {
+                return close() ? redis::error::stream_error : ec;
+            }
+        }
+        return std::error_code();
+    }
+
+    std::error_code skip_late_replies(std::chrono::steady_clock::time_point deadline, size_t keep)
+    {
+        for (; late_replies_ > keep; late_replies_--) {
+            size_t reply_size = 0;
+            auto ec = redis::wait_reply(*this, deadline, reply_size);
+            if (ec == redis::error::timed_out) {
+                return ec;
+            }
+            if (ec) {
+                return close() ? redis::error::stream_error : ec;
+            }
+            this->skip(reply_size);
+        }
         return std::error_code();
     }
+
+    std::error_code abort_pipeline(command_pipeline& batch, size_t from, std::error_code ec)
+    {
+        for (auto i = batch.entries.begin() + from, e = batch.entries.end(); i != e; ++i) {
+            i->result = ec;
+        }
+        return ec;
+    }
+
+    size_t late_replies_;
 };
 
 } // namespace "redis"
 
+// the definition of parse_typed, which needs the complete interfaces above
+#include "parser.h"
+
 #endif // REDIS_BASE_H
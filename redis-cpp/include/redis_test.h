@@ -1,14 +1,18 @@
 #ifndef REDIS_TEST_H
 #define REDIS_TEST_H
 
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <algorithm>
 #include <random>
+#include <functional>
 #include <cstdint>
 #include <cassert>
 
 #include "redis_base.h"
+#include "ring_stream.h"
 
 namespace redis_test
 {
@@ -208,6 +212,11 @@ struct mock_stream : public redis::stream
         return true;
     }
 
+    virtual size_t pending_output() const override
+    {
+        return output_buffer.size() - (flushed_offsets.empty() ? 0 : flushed_offsets.back());
+    }
+
 
     // helper functions
     void more_input(const char input[])
@@ -228,7 +237,7 @@ struct mock_stream : public redis::stream
 
     char* possible_end(size_t n)
     {
-        return current() + std::min(n, available());
+        return current() + std::min(n, mock_stream::available());
     }
 
     size_t input_offset;
@@ -249,6 +258,24 @@ inline bool operator!= (const reply& lhs, const reply& rhs)
 void serialize(const reply& r, redis::stream& output);
 const bool check_equal(const char expected[], mock_stream& output);
 
+// minimal in-memory server for transport tests - serves SET, GET and PING until the client goes away
+// or 'count' requests are served (zero means no limit), replies are flushed once no more request is buffered
+void serve_requests(redis::stream& server, size_t count = 0);
+
+// server of client tests behind its own ring_channel, with a single connection
+// answers every request with the bulk string 'name' after 'delay_ms', until the client closes the stream
+struct named_server
+{
+    named_server(char name);
+    ~named_server();
+
+    std::function<bool(redis::session<redis::ring_stream>&)> connector();
+
+    std::unique_ptr<redis::ring_channel> channel;
+    std::atomic<int> delay_ms;
+    std::thread server;
+};
+
 namespace {
     // initialize random seed with some magic number
     // I don't like those kinds of global vars, but this is just for test codes
@@ -0,0 +1,264 @@
+#ifndef REDIS_REPLICA_CLIENT_H
+#define REDIS_REPLICA_CLIENT_H
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "connection_pool.h"
+
+namespace redis
+{
+
+struct endpoint_stats
+{
+    endpoint_stats() : requests(0), errors(0), outstanding(0), latency_ewma(0) {}
+
+    uint64_t requests;
+    uint64_t errors;
+    uint32_t outstanding; // requests in flight
+    std::chrono::nanoseconds latency_ewma;
+};
+
+// client for a primary and its replicas, which spreads read-only commands over the replicas by their load
+// 'least_outstanding' sends a read to the replica with the fewest requests in flight, 'latency_p2c' picks two replicas
+// at random and sends it to the one with the lower latency EWMA times its requests in flight plus one (power of two
+// choices) - unlike round robin, both keep traffic away from a slow replica
+// the EWMA only changes with requests, so an EWMA not updated for 'ewma_decay' halves for each such period, and a replica
+// which was slow gets a request again once it looks faster than the others - its EWMA then tells whether it recovered
+// other commands go to the primary, and so do reads when there is no replica or the chosen one gives no connection
+// a request is recorded in the stats of the endpoint which served it
+// thread-safety : safe in shared
+template<typename stream_type>
+class replica_client
+{
+public:
+    typedef connection_pool<stream_type> pool_type;
+    typedef typename pool_type::connector_type connector_type;
+
+    enum balance_policy
+    {
+        least_outstanding,
+        latency_p2c,
+    };
+
+    // the primary is endpoint 0, and replica i is endpoint i + 1
+    static const size_t primary_endpoint = 0;
+
+    struct options
+    {
+        options()
+            : policy(least_outstanding), connections_per_endpoint(8), wait_timeout(std::chrono::milliseconds(1000)), ewma_weight(0.2),
+            ewma_decay(std::chrono::milliseconds(1000))
+        {
+        }
+
+        balance_policy policy;
+        size_t connections_per_endpoint;
+        std::chrono::milliseconds wait_timeout;
+        double ewma_weight; // of the latest request
+        std::chrono::milliseconds ewma_decay; // zero keeps stale EWMAs
+    };
+
+    replica_client(connector_type primary, const std::vector<connector_type>& replicas, const options& opts = options())
+        : options_(opts), next_(0)
+    {
+        endpoints_.emplace_back(new endpoint(primary, opts));
+        for (auto i = replicas.begin(), e = replicas.end(); i != e; ++i) {
+            endpoints_.emplace_back(new endpoint(*i, opts));
+        }
+    }
+
+    // endpoint the command would be sent to now
+    size_t route(const command& cmd)
+    {
+        if (!cmd.is_read_only() || endpoints_.size() == 1) {
+            return primary_endpoint;
+        }
+        return options_.policy == latency_p2c ? pick_by_latency() : pick_least_outstanding();
+    }
+
+    template<typename command_type>
+    std::error_code request(command_type& cmd)
+    {
+        return request(cmd, cmd.reply);
+    }
+
+    std::error_code request(const command& cmd, reply_handler& handler)
+    {
+        auto index = route(cmd);
+        auto target = endpoints_[index].get();
+
+        target->outstanding.fetch_add(1, std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+
+        std::error_code ec;
+        {
+            auto connection = target->pool->checkout();
+            if (!connection && index != primary_endpoint) {
+                // the primary serves the read, so its stats record it - the replica pool counts the failed checkout
+                target->outstanding.fetch_sub(1, std::memory_order_relaxed);
+                target = endpoints_[primary_endpoint].get();
+                target->outstanding.fetch_add(1, std::memory_order_relaxed);
+                start = std::chrono::steady_clock::now();
+                connection = target->pool->checkout();
+            }
+            ec = connection ? send_and_receive(*connection, cmd, handler) : redis::error::no_connection;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        target->record(now - start, now, ec && ec != redis::error::error_reply, options_.ewma_weight);
+        target->outstanding.fetch_sub(1, std::memory_order_relaxed);
+        return ec;
+    }
+
+    size_t endpoint_count() const
+    {
+        return endpoints_.size();
+    }
+
+    endpoint_stats stats(size_t index) const
+    {
+        auto& e = *endpoints_[index];
+
+        endpoint_stats result;
+        result.requests = e.requests.load(std::memory_order_relaxed);
+        result.errors = e.errors.load(std::memory_order_relaxed);
+        result.outstanding = e.outstanding.load(std::memory_order_relaxed);
+        result.latency_ewma = std::chrono::nanoseconds(e.ewma_nanoseconds.load(std::memory_order_relaxed));
+        return result;
+    }
+
+    pool_type& pool(size_t index)
+    {
+        return *endpoints_[index]->pool;
+    }
+
+private:
+    struct endpoint
+    {
+        endpoint(connector_type connector, const options& opts)
+            : requests(0), errors(0), outstanding(0), ewma_nanoseconds(0), updated_nanoseconds(0)
+        {
+            typename pool_type::options pool_options;
+            pool_options.max_size = opts.connections_per_endpoint;
+            pool_options.wait_timeout = opts.wait_timeout;
+            pool.reset(new pool_type(std::move(connector), pool_options));
+        }
+
+        void record(std::chrono::steady_clock::duration latency, std::chrono::steady_clock::time_point now, bool failed, double weight)
+        {
+            auto nanoseconds = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+
+            if (requests.fetch_add(1, std::memory_order_relaxed) == 0) {
+                weight = 1; // the first sample is the whole average
+            }
+            if (failed) {
+                errors.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            auto average = ewma_nanoseconds.load(std::memory_order_relaxed);
+            for (;;) {
+                auto updated = average + static_cast<int64_t>(weight * (nanoseconds - average));
+                if (ewma_nanoseconds.compare_exchange_weak(average, updated, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            updated_nanoseconds.store(to_nanoseconds(now), std::memory_order_relaxed);
+        }
+
+        std::unique_ptr<pool_type> pool;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint32_t> outstanding;
+        std::atomic<int64_t> ewma_nanoseconds;
+        std::atomic<int64_t> updated_nanoseconds; // of the steady clock, when the EWMA was updated last
+    };
+
+    // unlike session::request, an error reply keeps the pooled connection and is not counted as a failure of the endpoint
+    static std::error_code send_and_receive(session<stream_type>& connection, const command& cmd, reply_handler& handler)
+    {
+        auto ec = connection.send_request(cmd);
+        return ec ? ec : connection.receive_reply(handler);
+    }
+
+    static int64_t to_nanoseconds(std::chrono::steady_clock::time_point time)
+    {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+    }
+
+    size_t pick_least_outstanding()
+    {
+        // the scan starts at a rotating replica, so that ties do not all go to the first one
+        auto replicas = endpoints_.size() - 1;
+        auto first = next_.fetch_add(1, std::memory_order_relaxed);
+
+        size_t best = 0;
+        uint32_t best_outstanding = UINT32_MAX;
+        for (size_t i = 0; i < replicas; i++) {
+            auto index = 1 + (first + i) % replicas;
+            auto outstanding = endpoints_[index]->outstanding.load(std::memory_order_relaxed);
+            if (outstanding < best_outstanding) {
+                best = index;
+                best_outstanding = outstanding;
+            }
+        }
+        return best;
+    }
+
+    size_t pick_by_latency()
+    {
+        auto replicas = endpoints_.size() - 1;
+        if (replicas == 1) {
+            return 1;
+        }
+
+        thread_local std::minstd_rand random(static_cast<uint32_t>(std::random_device()()));
+        auto a = 1 + random() % replicas;
+        auto b = 1 + (a + random() % (replicas - 1)) % replicas; // never the same as 'a'
+
+        auto& x = *endpoints_[a];
+        auto& y = *endpoints_[b];
+        auto now = to_nanoseconds(std::chrono::steady_clock::now());
+        auto outstanding_x = x.outstanding.load(std::memory_order_relaxed);
+        auto outstanding_y = y.outstanding.load(std::memory_order_relaxed);
+
+        // the expected wait behind the requests in flight
+        auto score_x = decayed_latency(x, now) * (outstanding_x + 1);
+        auto score_y = decayed_latency(y, now) * (outstanding_y + 1);
+        if (score_x != score_y) {
+            return score_x < score_y ? a : b;
+        }
+        return outstanding_x <= outstanding_y ? a : b;
+    }
+
+    double decayed_latency(const endpoint& e, int64_t now) const
+    {
+        auto average = static_cast<double>(e.ewma_nanoseconds.load(std::memory_order_relaxed));
+        auto decay = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.ewma_decay).count();
+        if (decay <= 0) {
+            return average;
+        }
+
+        auto periods = (now - e.updated_nanoseconds.load(std::memory_order_relaxed)) / decay;
+        return periods > 0 ? std::ldexp(average, -static_cast<int>(std::min<int64_t>(periods, 1024))) : average;
+    }
+
+    options options_;
+    std::vector<std::unique_ptr<endpoint>> endpoints_;
+    std::atomic<size_t> next_;
+};
+
+template<typename stream_type>
+const size_t replica_client<stream_type>::primary_endpoint;
+
+} // namespace "redis"
+
+#endif // REDIS_REPLICA_CLIENT_H
@@ -68,7 +68,7 @@ public:
 struct bulk_data
 {
     bulk_data() : is_null(true) {}
-    bulk_data(const char* begin, const char* end) : data(begin, end) {}
+    bulk_data(const char* begin, const char* end) : is_null(false), data(begin, end) {}
 
     bool is_null;
     std::vector<char> data;
@@ -126,10 +126,18 @@ struct bulk_reply : public reply_handler_base
 public:
     bulk_reply() {}
 
+    virtual buffer_view on_bulk_buffer(size_t size) override
+    {
+        result.data.resize(size);
+        return buffer_view(result.data.data(), size);
+    }
+
     virtual bool on_bulk(const_buffer_view data) override
     {
         result.is_null = false;
-        result.data = std::vector<char>(data.begin(), data.end());
+        if (data.data() != result.data.data()) { // not received in place
+            result.data = std::vector<char>(data.begin(), data.end());
+        }
         return true;
     }
 
@@ -152,9 +160,19 @@ public:
         return true;
     }
 
+    virtual buffer_view on_bulk_buffer(size_t size) override
+    {
+        result.push_back(bulk_data());
+        result.back().is_null = false;
+        result.back().data.resize(size);
+        return buffer_view(result.back().data.data(), size);
+    }
+
     virtual bool on_bulk(const_buffer_view data) override
     {
-        result.push_back(bulk_data(data.begin(), data.end()));
+        if (result.empty() || data.data() != result.back().data.data()) { // not received in place
+            result.push_back(bulk_data(data.begin(), data.end()));
+        }
         return true;
     }
 
@@ -0,0 +1,161 @@
+#ifndef REDIS_REPLY_SCANNER_H
+#define REDIS_REPLY_SCANNER_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "redis_base.h"
+
+namespace redis
+{
+
+// incremental framing check for a reply arriving in pieces
+// the scanner only finds where a reply ends, so that a non-blocking reader knows when to hand the buffered reply
+// over to the synchronous parser - it remembers how far it got, and each call only looks at the new bytes
+// thread-safety : safe in distinct, not safe in shared
+class reply_scanner
+{
+public:
+    enum result
+    {
+        incomplete,
+        complete,
+        ill_formed,
+    };
+
+    reply_scanner()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        scanned_ = 0;
+        bulk_remaining_ = 0;
+        pending_.clear();
+    }
+
+    // 'input' starts at the beginning of the reply and holds everything received so far
+    // it may move between calls, but the bytes already scanned should stay the same
+    result scan(const_buffer_view input)
+    {
+        while (scanned_ < input.size()) {
+            if (bulk_remaining_ > 0) { // bulk data and its CRLF
+                auto size = std::min<size_t>(bulk_remaining_, input.size() - scanned_);
+                scanned_ += size;
+                bulk_remaining_ -= size;
+                if (bulk_remaining_ > 0) {
+                    return incomplete;
+                }
+                if (element_done()) {
+                    return complete;
+                }
+                continue;
+            }
+
+            auto line = input.begin() + scanned_;
+            auto line_end = std::find(line, input.end(), '\n');
+            if (line_end == input.end()) {
+                return incomplete;
+            }
+            if (line_end - line < 2 || *(line_end - 1) != '\r') {
+                return ill_formed;
+            }
+            scanned_ = (line_end - input.begin()) + 1;
+
+            int64_t count = 0;
+            switch (*line) {
+            case '+':
+            case '-':
+            case ':':
+                if (element_done()) {
+                    return complete;
+                }
+                break;
+
+            case '$':
+                if (!read_integer(line + 1, line_end - 1, count)) {
+                    return ill_formed;
+                }
+                if (count >= 0) {
+                    bulk_remaining_ = static_cast<size_t>(count) + 2;
+                } else if (element_done()) {
+                    return complete;
+                }
+                break;
+
+            case '*':
+                if (!read_integer(line + 1, line_end - 1, count)) {
+                    return ill_formed;
+                }
+                if (count > 0) {
+                    pending_.push_back(static_cast<size_t>(count));
+                } else if (element_done()) {
+                    return complete;
+                }
+                break;
+
+            default:
+                return ill_formed;
+            }
+        }
+        return incomplete;
+    }
+
+    // size of the reply once scan returned 'complete'
+    size_t reply_size() const
+    {
+        return scanned_;
+    }
+
+    // bytes of bulk data (and its CRLF) the reply needs next, zero in between elements
+    // a reader may receive them in place, as they certainly belong to the reply
+    size_t bulk_remaining() const
+    {
+        return bulk_remaining_;
+    }
+
+private:
+    // returns true when the element finishes the whole reply
+    bool element_done()
+    {
+        while (!pending_.empty()) {
+            if (--pending_.back() > 0) {
+                return false;
+            }
+            pending_.pop_back();
+        }
+        return true;
+    }
+
+    static bool read_integer(const char* i, const char* e, int64_t& output)
+    {
+        int64_t sign = 1;
+        if (i != e && *i == '-') {
+            sign = -1;
+            ++i;
+        }
+        if (i == e) {
+            return false;
+        }
+
+        int64_t value = 0;
+        for (; i != e; ++i) {
+            if (*i < '0' || *i > '9') {
+                return false;
+            }
+            value = value * 10 + (*i - '0');
+        }
+        output = value * sign;
+        return true;
+    }
+
+    size_t scanned_;
+    size_t bulk_remaining_;
+    std::vector<size_t> pending_; // remaining elements of each enclosing multi bulk reply
+};
+
+} // namespace "redis"
+
+#endif // REDIS_REPLY_SCANNER_H
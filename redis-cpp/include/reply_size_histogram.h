@@ -0,0 +1,85 @@
+#ifndef REDIS_REPLY_SIZE_HISTOGRAM_H
+#define REDIS_REPLY_SIZE_HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace redis
+{
+
+// sizes of the recent replies of a connection, for sizing its buffers
+// every 'window' samples the counts are halved, so that the histogram follows a change of the workload
+// thread-safety : safe in distinct, not safe in shared
+class reply_size_histogram
+{
+public:
+    // bucket i counts sizes below 2^i bytes, the last one counts the rest
+    static const size_t bucket_count = 32;
+
+    explicit reply_size_histogram(uint32_t window = 256) : window_(window > 0 ? window : 1), samples_(0), since_decay_(0)
+    {
+        buckets_.fill(0);
+    }
+
+    void record(size_t bytes)
+    {
+        size_t bucket = 0;
+        for (auto b = bytes; b > 0 && bucket + 1 < bucket_count; b >>= 1) {
+            bucket++;
+        }
+        buckets_[bucket]++;
+        samples_++;
+
+        if (++since_decay_ >= window_) {
+            decay();
+        }
+    }
+
+    // weight of the recent samples, which decays with the counts
+    uint64_t samples() const
+    {
+        return samples_;
+    }
+
+    // upper bound of the size of the given fraction (0.9 for p90) of the recent replies, zero without samples
+    size_t percentile(double fraction) const
+    {
+        uint64_t target = static_cast<uint64_t>(fraction * samples_);
+        uint64_t counted = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            counted += buckets_[i];
+            if (counted > 0 && counted >= target) {
+                return static_cast<size_t>(1) << i;
+            }
+        }
+        return 0;
+    }
+
+    void clear()
+    {
+        buckets_.fill(0);
+        samples_ = 0;
+        since_decay_ = 0;
+    }
+
+private:
+    void decay()
+    {
+        samples_ = 0;
+        for (auto& b : buckets_) {
+            b >>= 1;
+            samples_ += b;
+        }
+        since_decay_ = 0;
+    }
+
+    uint32_t window_;
+    uint64_t samples_;
+    uint32_t since_decay_;
+    std::array<uint64_t, bucket_count> buckets_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_REPLY_SIZE_HISTOGRAM_H
@@ -0,0 +1,110 @@
+#ifndef REDIS_RING_STREAM_H
+#define REDIS_RING_STREAM_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "buffer_pool.h"
+#include "spsc_ring.h"
+
+namespace redis
+{
+
+// a pair of spsc rings connecting a client and its peer
+// the memory is either owned by the process (in-process peer) or a named POSIX shared memory segment (same-host peer)
+class ring_channel
+{
+public:
+    enum side
+    {
+        client_side,
+        server_side,
+    };
+
+    ~ring_channel();
+
+    // 'capacity' of each direction is rounded up to a power of two
+    static std::unique_ptr<ring_channel> create(size_t capacity = 1 << 20);
+    static std::unique_ptr<ring_channel> create_shared(const std::string& name, size_t capacity = 1 << 20);
+    static std::unique_ptr<ring_channel> open_shared(const std::string& name);
+
+    // attaches rings for the given side - 'input' is read by the side, 'output' is written by it
+    void attach(side s, spsc_ring& input, spsc_ring& output);
+
+private:
+    ring_channel();
+
+    void* memory_;
+    size_t memory_size_;
+    size_t capacity_;
+    bool shared_;
+    bool owner_;
+    std::string name_;
+    std::vector<char> local_memory_;
+};
+
+
+// redis::stream over a ring_channel - a transport without kernel networking, mainly for benchmarks
+// reads spin (and yield) until the peer publishes data, so both sides should run on their own threads
+// thread-safety : safe in distinct, not safe in shared
+struct ring_stream : public stream
+{
+public:
+    ring_stream(size_t initial_buffer_size = 16384);
+    ~ring_stream();
+
+    // redis::stream interface implementation
+    virtual bool close() override;
+    virtual bool is_open() const override;
+
+    // redis::stream input interface implementation
+    virtual size_t available() const override;
+    virtual const_buffer_view peek(size_t n) override;
+    virtual const_buffer_view read(size_t n) override;
+    virtual size_t skip(size_t n) override;
+    virtual bool wait_readable(std::chrono::milliseconds timeout) override;
+
+    // redis::stream output interface implementation
+    virtual bool flush() override;
+    virtual bool write(const_buffer_view input) override;
+    virtual size_t pending_output() const override;
+
+    // ring_stream member functions
+    bool connect(ring_channel& channel, ring_channel::side s = ring_channel::client_side);
+
+    // a flush fails when the peer closed the stream, or did not make room in the ring for 'timeout' (a dead peer)
+    // zero waits forever
+    void set_flush_timeout(std::chrono::milliseconds timeout)
+    {
+        flush_timeout_ = timeout;
+    }
+
+private:
+    // utility functions
+    void reset();
+
+    std::pair<buffer_view, buffer_view> ensure_available_buffer(size_t at_least);
+    bool read_from_ring(size_t at_least);
+    void move_and_ensure_read_buffer(size_t at_least);
+
+    buffer_view unused_read_buffer();
+
+private:
+    pooled_buffer read_buffer_;
+    pooled_buffer write_buffer_;
+    buffer_view to_be_read_;
+    size_t written_;
+    std::chrono::milliseconds flush_timeout_;
+
+    spsc_ring input_;
+    spsc_ring output_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_RING_STREAM_H
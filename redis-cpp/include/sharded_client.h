@@ -0,0 +1,339 @@
+#ifndef REDIS_SHARDED_CLIENT_H
+#define REDIS_SHARDED_CLIENT_H
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "redis_base.h"
+#include "spsc_queue.h"
+#include "mpsc_queue.h"
+
+namespace redis
+{
+
+// pins the calling thread to the given CPU, returns false if it is not supported or failed
+bool pin_current_thread(size_t cpu);
+
+// maps a key to one of 'shard_count' shards, the same way in every process
+size_t shard_for_key(const_buffer_view key, size_t shard_count);
+
+
+// shared-nothing client : every shard is a thread, optionally pinned to its own CPU, which owns its connections
+// work is given to a shard as tasks which run on its thread and use its connections without any synchronization
+// tasks posted from the same shard go through a plain local queue, tasks submitted from another shard go through
+// an spsc_queue per (source, target) pair, and only threads outside the client use a shared queue
+// thread-safety : submit and submit_for_key are safe in shared, even while another thread stops the client - stop waits
+// for the submits in progress, and later ones fail - start and stop are not safe in shared, and shard members are only
+// for tasks running on that shard
+template<typename stream_type>
+class sharded_client
+{
+public:
+    class shard;
+
+    typedef std::function<void(shard&)> task_type;
+
+    // connects a session of the given shard, called on the shard's own thread
+    typedef std::function<bool(session<stream_type>& connection, size_t shard_index)> connector_type;
+
+    struct options
+    {
+        options()
+            : shard_count(std::thread::hardware_concurrency()), connections_per_shard(1), queue_capacity(4096),
+              pin_threads(true), first_cpu(0), idle_sleep(std::chrono::microseconds(50))
+        {
+        }
+
+        size_t shard_count;
+        size_t connections_per_shard;
+        size_t queue_capacity;       // capacity of each cross-shard queue
+        bool pin_threads;            // shard i runs on CPU first_cpu + i
+        size_t first_cpu;
+        std::chrono::microseconds idle_sleep; // sleep of an idle shard after spinning, zero keeps spinning
+    };
+
+    class shard
+    {
+    public:
+        ~shard()
+        {
+            for (auto node = external_.pop_all(); node != nullptr;) {
+                auto next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+
+        size_t index() const
+        {
+            return index_;
+        }
+
+        size_t connection_count() const
+        {
+            return connections_.size();
+        }
+
+        session<stream_type>& connection(size_t i = 0)
+        {
+            return *connections_[i];
+        }
+
+        // runs the task later on this shard
+        void post(task_type task)
+        {
+            local_.push_back(std::move(task));
+        }
+
+        // runs the task on the target shard, returns false if the queue towards it is full
+        bool submit(size_t target, task_type task)
+        {
+            if (target == index_) {
+                post(std::move(task));
+                return true;
+            }
+            return owner_.shards_[target]->inbound_[index_]->push(std::move(task));
+        }
+
+    private:
+        friend class sharded_client;
+
+        struct external_task
+        {
+            task_type task;
+            external_task* next;
+        };
+
+        shard(sharded_client& owner, size_t index) : owner_(owner), index_(index) {}
+
+        bool connect(const connector_type& connector, size_t count)
+        {
+            for (size_t i = 0; i < count; i++) {
+                connections_.emplace_back(new session<stream_type>());
+                if (!connector(*connections_.back(), index_)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void run(const connector_type& connector, std::promise<bool>& ready)
+        {
+            auto& opts = owner_.options_;
+            if (opts.pin_threads) {
+                pin_current_thread(opts.first_cpu + index_);
+            }
+
+            auto connected = connect(connector, opts.connections_per_shard);
+            ready.set_value(connected);
+
+            size_t idle = 0;
+            while (connected) {
+                if (run_once()) {
+                    idle = 0;
+                    continue;
+                }
+
+                // the stop flag is only looked at when there is nothing to do, so queued work is finished first
+                if (owner_.stopping_.load(std::memory_order_acquire)) {
+                    if (!run_once()) {
+                        break;
+                    }
+                    continue;
+                }
+
+                if (++idle < 1024) {
+                    continue;
+                }
+                if (opts.idle_sleep.count() > 0) {
+                    std::this_thread::sleep_for(opts.idle_sleep);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+
+            for (auto i = connections_.begin(), e = connections_.end(); i != e; ++i) {
+                (*i)->close();
+            }
+        }
+
+        // runs every task queued so far, returns false if there was none
+        bool run_once()
+        {
+            bool worked = false;
+
+            // tasks posted by these tasks wait for the next round, so that the inbound queues are not starved
+            std::deque<task_type> batch;
+            batch.swap(local_);
+            for (auto i = batch.begin(), e = batch.end(); i != e; ++i) {
+                (*i)(*this);
+                worked = true;
+            }
+
+            task_type task;
+            for (auto i = inbound_.begin(), e = inbound_.end(); i != e; ++i) {
+                while ((*i)->pop(task)) {
+                    task(*this);
+                    worked = true;
+                }
+            }
+
+            for (auto node = external_.pop_all(); node != nullptr;) {
+                node->task(*this);
+                worked = true;
+
+                auto next = node->next;
+                delete node;
+                node = next;
+            }
+            return worked;
+        }
+
+        sharded_client& owner_;
+        size_t index_;
+        std::vector<std::unique_ptr<session<stream_type>>> connections_;
+
+        std::deque<task_type> local_;
+        std::vector<std::unique_ptr<spsc_queue<task_type>>> inbound_; // indexed by the source shard
+        mpsc_queue<external_task> external_;
+
+        std::thread thread_;
+    };
+
+    sharded_client() : running_(false), submitters_(0), stopping_(false) {}
+
+    ~sharded_client()
+    {
+        stop();
+    }
+
+    // starts the shards and connects their sessions, returns false if any shard failed to connect
+    bool start(const connector_type& connector, const options& opts = options())
+    {
+        if (running_ || opts.shard_count == 0) {
+            return false;
+        }
+
+        options_ = opts;
+        stopping_.store(false);
+
+        for (size_t i = 0; i < opts.shard_count; i++) {
+            shards_.emplace_back(new shard(*this, i));
+            for (size_t j = 0; j < opts.shard_count; j++) {
+                shards_.back()->inbound_.emplace_back(new spsc_queue<task_type>(j == i ? 1 : opts.queue_capacity));
+            }
+        }
+
+        std::vector<std::promise<bool>> ready(opts.shard_count);
+        for (size_t i = 0; i < opts.shard_count; i++) {
+            auto s = shards_[i].get();
+            auto r = &ready[i];
+            s->thread_ = std::thread([s, r, &connector] { s->run(connector, *r); });
+        }
+
+        bool connected = true;
+        for (auto i = ready.begin(), e = ready.end(); i != e; ++i) {
+            connected = i->get_future().get() && connected;
+        }
+
+        running_ = true;
+        if (!connected) {
+            stop();
+        }
+        return connected;
+    }
+
+    // every shard finishes the tasks queued to it, then closes its connections
+    // tasks submitted to a shard which already finished are dropped, so tasks should not keep submitting while stopping
+    void stop()
+    {
+        if (!running_.exchange(false)) {
+            return;
+        }
+
+        // submits which saw the client running still use the shards
+        while (submitters_.load() > 0) {
+            std::this_thread::yield();
+        }
+
+        stopping_.store(true, std::memory_order_release);
+        for (auto i = shards_.begin(), e = shards_.end(); i != e; ++i) {
+            (*i)->thread_.join();
+        }
+        shards_.clear();
+    }
+
+    size_t shard_count() const
+    {
+        return shards_.size();
+    }
+
+    // runs the task on the given shard - for threads outside the client, tasks use shard::submit instead
+    bool submit(size_t shard_index, task_type task)
+    {
+        submit_guard guard(*this);
+        return guard.running() && push_external(shard_index, std::move(task));
+    }
+
+    // runs the task on the shard owning the key
+    bool submit_for_key(const_buffer_view key, task_type task)
+    {
+        submit_guard guard(*this);
+        return guard.running() && push_external(shard_for_key(key, shards_.size()), std::move(task));
+    }
+
+private:
+    // counts a submit in progress, so that stop does not destroy the shards under it
+    // the count is raised before running_ is read, and stop clears running_ before it waits for the count
+    class submit_guard
+    {
+    public:
+        submit_guard(sharded_client& owner) : owner_(owner)
+        {
+            owner_.submitters_.fetch_add(1);
+        }
+
+        ~submit_guard()
+        {
+            owner_.submitters_.fetch_sub(1);
+        }
+
+        bool running() const
+        {
+            return owner_.running_.load();
+        }
+
+    private:
+        sharded_client& owner_;
+    };
+
+    bool push_external(size_t shard_index, task_type task)
+    {
+        if (shard_index >= shards_.size()) {
+            return false;
+        }
+
+        auto node = new typename shard::external_task;
+        node->task = std::move(task);
+        shards_[shard_index]->external_.push(node);
+        return true;
+    }
+
+    options options_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::atomic<bool> running_;
+    std::atomic<size_t> submitters_;
+    std::atomic<bool> stopping_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_SHARDED_CLIENT_H
@@ -0,0 +1,81 @@
+#ifndef REDIS_SPSC_QUEUE_H
+#define REDIS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace redis
+{
+
+// bounded lock-free single-producer single-consumer queue of values
+// the byte-oriented counterpart is spsc_ring, this one moves objects between two threads
+// thread-safety : one producer thread and one consumer thread
+template<typename value_type>
+class spsc_queue
+{
+public:
+    // 'capacity' is rounded up to a power of two
+    explicit spsc_queue(size_t capacity = 1024) : head_(0), cached_tail_(0), tail_(0), cached_head_(0)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    // producer side : returns false when the queue is full, leaving 'value' untouched
+    bool push(value_type&& value)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) {
+                return false;
+            }
+        }
+
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side : returns false when the queue is empty
+    bool pop(value_type& value)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+
+        value = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = value_type();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<value_type> slots_;
+    size_t mask_;
+
+    // each side keeps a local copy of the other side's position to avoid touching its cache line on every call
+    alignas(64) std::atomic<size_t> head_; // owned by the consumer
+    size_t cached_tail_;
+    alignas(64) std::atomic<size_t> tail_; // owned by the producer
+    size_t cached_head_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_SPSC_QUEUE_H
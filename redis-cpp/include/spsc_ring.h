@@ -0,0 +1,161 @@
+#ifndef REDIS_SPSC_RING_H
+#define REDIS_SPSC_RING_H
+
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+#include "redis_base.h"
+
+namespace redis
+{
+
+// lock-free single-producer single-consumer byte ring
+// the ring is placed on caller-provided memory, so that it can live in a shared memory segment mapped by two processes
+// thread-safety : one producer thread and one consumer thread
+class spsc_ring
+{
+public:
+    struct header
+    {
+        alignas(64) std::atomic<uint64_t> head; // read position, owned by the consumer
+        alignas(64) std::atomic<uint64_t> tail; // write position, owned by the producer
+        alignas(64) uint64_t capacity;
+        std::atomic<uint32_t> closed;
+    };
+
+    static size_t required_size(size_t capacity)
+    {
+        return sizeof(header) + capacity;
+    }
+
+    spsc_ring() : header_(nullptr), data_(nullptr), mask_(0), cached_head_(0), cached_tail_(0) {}
+
+    // 'capacity' should be a power of two, and 'memory' should hold required_size(capacity) bytes
+    // only the side creating the memory initializes it
+    void attach(void* memory, size_t capacity, bool initialize)
+    {
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+        if (initialize) {
+            header_ = new (memory) header();
+            header_->head.store(0, std::memory_order_relaxed);
+            header_->tail.store(0, std::memory_order_relaxed);
+            header_->capacity = capacity;
+            header_->closed.store(0, std::memory_order_release);
+        } else {
+            header_ = static_cast<header*>(memory);
+        }
+
+        data_ = static_cast<char*>(memory) + sizeof(header);
+        mask_ = capacity - 1;
+        cached_head_ = header_->head.load(std::memory_order_acquire);
+        cached_tail_ = header_->tail.load(std::memory_order_acquire);
+    }
+
+    void detach()
+    {
+        header_ = nullptr;
+        data_ = nullptr;
+    }
+
+    bool is_attached() const
+    {
+        return header_ != nullptr;
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    // producer side : copies as much of the input as fits and publishes it
+    size_t write_some(const_buffer_view input)
+    {
+        auto tail = header_->tail.load(std::memory_order_relaxed);
+        if (capacity() - (tail - cached_head_) < input.size()) {
+            cached_head_ = header_->head.load(std::memory_order_acquire);
+        }
+
+        auto size = std::min<size_t>(input.size(), capacity() - (tail - cached_head_));
+        if (size == 0) {
+            return 0;
+        }
+
+        auto offset = static_cast<size_t>(tail & mask_);
+        auto first = std::min(size, capacity() - offset);
+        std::copy(input.begin(), input.begin() + first, data_ + offset);
+        std::copy(input.begin() + first, input.begin() + size, data_);
+
+        header_->tail.store(tail + size, std::memory_order_release);
+        return size;
+    }
+
+    // consumer side : copies as much of the published data as fits into the output
+    size_t read_some(buffer_view output)
+    {
+        auto head = header_->head.load(std::memory_order_relaxed);
+        if (cached_tail_ - head < output.size()) {
+            cached_tail_ = header_->tail.load(std::memory_order_acquire);
+        }
+
+        auto size = std::min<size_t>(output.size(), cached_tail_ - head);
+        if (size == 0) {
+            return 0;
+        }
+
+        auto offset = static_cast<size_t>(head & mask_);
+        auto first = std::min(size, capacity() - offset);
+        std::copy(data_ + offset, data_ + offset + first, output.begin());
+        std::copy(data_, data_ + (size - first), output.begin() + first);
+
+        header_->head.store(head + size, std::memory_order_release);
+        return size;
+    }
+
+    size_t readable() const
+    {
+        return static_cast<size_t>(header_->tail.load(std::memory_order_acquire) - header_->head.load(std::memory_order_relaxed));
+    }
+
+    // producer side : no more data will be written
+    void close()
+    {
+        header_->closed.fetch_or(writer_closed, std::memory_order_release);
+    }
+
+    bool is_closed() const
+    {
+        return (header_->closed.load(std::memory_order_acquire) & writer_closed) != 0;
+    }
+
+    // consumer side : no more data will be read, so the producer should not wait for space
+    void close_reader()
+    {
+        header_->closed.fetch_or(reader_closed, std::memory_order_release);
+    }
+
+    bool is_reader_closed() const
+    {
+        return (header_->closed.load(std::memory_order_acquire) & reader_closed) != 0;
+    }
+
+private:
+    static const uint32_t writer_closed = 1;
+    static const uint32_t reader_closed = 2;
+
+    header* header_;
+    char* data_;
+    size_t mask_;
+
+    // local copies of the other side's position to avoid touching its cache line on every call
+    uint64_t cached_head_;
+    uint64_t cached_tail_;
+};
+
+} // namespace "redis"
+
+#endif // REDIS_SPSC_RING_H
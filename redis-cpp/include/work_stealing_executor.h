@@ -0,0 +1,80 @@
+#ifndef REDIS_WORK_STEALING_EXECUTOR_H
+#define REDIS_WORK_STEALING_EXECUTOR_H
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <system_error>
+
+#include "redis_base.h"
+
+namespace redis
+{
+
+// thread pool in which every worker has its own task queue
+// a worker runs its newest task first and steals the oldest task of another worker when its own queue is empty,
+// tasks submitted by a worker go to its own queue, other threads spread their tasks over the workers
+// thread-safety : safe in shared
+class work_stealing_executor
+{
+public:
+    typedef std::function<void()> task_type;
+
+    explicit work_stealing_executor(size_t thread_count = std::thread::hardware_concurrency());
+
+    // runs every submitted task before joining the workers
+    ~work_stealing_executor();
+
+    void submit(task_type task);
+
+    size_t thread_count() const
+    {
+        return workers_.size();
+    }
+
+    // tasks taken from another worker's queue
+    uint64_t steal_count() const
+    {
+        return steals_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct worker
+    {
+        std::mutex lock;
+        std::deque<task_type> tasks;
+        std::thread thread;
+    };
+
+    void run(size_t index);
+    bool take(size_t index, task_type& task);
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> sleeping_;
+    std::atomic<uint64_t> steals_;
+    std::atomic<bool> stopping_;
+
+    std::mutex sleep_lock_;
+    std::condition_variable wake_up_;
+};
+
+
+// hands the decoding of a reply over to a work_stealing_executor, so that the I/O thread keeps reading
+// the calling thread only finds the end of the next reply of 'input' with reply_scanner and copies its bytes once into
+// a buffer owned by the task - bulk data which is not buffered yet is received straight into it - and 'handler' is
+// called by a worker parsing that buffer, which stays alive until the handler returns
+// 'done' is called on the worker with the result of the handler parse
+// returns the error of reading the reply, in which case neither 'handler' nor 'done' is called
+std::error_code dispatch_reply(stream& input, work_stealing_executor& executor, std::shared_ptr<reply_handler> handler,
+    std::function<void(std::error_code)> done = std::function<void(std::error_code)>());
+
+} // namespace "redis"
+
+#endif // REDIS_WORK_STEALING_EXECUTOR_H
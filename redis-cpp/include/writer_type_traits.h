@@ -124,6 +124,21 @@ struct writer_type_traits<const_buffer_view>
     }
 };
 
+template<>
+struct writer_type_traits<file_region>
+{
+    static const bool static_count = true;
+    static const size_t count = 1;
+    inline static bool write(stream& output, const file_region& region)
+    {
+        return output.write('$') &&
+            detail::write_integer(output, region.length) &&
+            detail::write_newline(output) &&
+            output.write_file(region) &&
+            detail::write_newline(output);
+    }
+};
+
 template<typename T>
 struct writer_type_traits<
     T,
@@ -2,25 +2,113 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <memory>
+#include <chrono>
+#include <thread>
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/system/error_code.hpp>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <cerrno>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#endif
+
+#ifndef _WIN32
+#include <poll.h>
+#include <climits>
+#include <sys/time.h>
+#include <cerrno>
+#endif
+
 #include "redis_base.h"
 
 namespace {
 
 boost::asio::io_service io_service(8);
 
+// synchronous lookup, which does not run the io_service
+bool resolve_endpoint(const std::string& host, uint16_t port, boost::asio::ip::tcp::endpoint& endpoint, boost::system::error_code& err)
+{
+	using boost::asio::ip::tcp;
+
+	tcp::resolver resolver(io_service);
+	tcp::resolver::query query(host, boost::lexical_cast<std::string>(port)); // v6?
+
+	auto iterator = resolver.resolve(query, err);
+	if (err) {
+		return false;
+	}
+
+	endpoint = iterator->endpoint();
+	return true;
+}
+
+// buffers inflated beyond this by a large transfer are released once the transfer completes
+const size_t default_shrink_threshold = 1 << 20;
+
+#ifdef __linux__
+const size_t max_pinned_buffers = 8;
+const size_t max_spare_buffers = 2;
+#endif
+
 } // the end of anonymous namespace
 
+char asio_stream_adaptor::unallocated_ = 0;
+
 asio_stream_adaptor::asio_stream_adaptor(size_t initial_buffer_size)
-	: read_buffer_(initial_buffer_size), write_buffer_(initial_buffer_size), socket_(io_service)
+	: initial_buffer_size_(initial_buffer_size), shrink_threshold_(default_shrink_threshold),
+	received_since_drain_(0), read_size_fraction_(0), read_size_min_samples_(0), last_activity_(std::chrono::steady_clock::now()),
+	base_memory_(redis::buffer_pool::block_size(initial_buffer_size) * 2), charged_memory_(0), socket_(io_service)
+{
+#ifdef __linux__
+	busy_poll_budget_ = std::chrono::microseconds(0);
+	busy_poll_yield_ = false;
+	so_busy_poll_ = 0;
+	kernel_busy_poll_ = false;
+	busy_poll_stats_ = busy_poll_stats();
+	io_time_out_ = 0;
+#endif
+	reset();
+}
+
+asio_stream_adaptor::asio_stream_adaptor(boost::asio::io_service& io, size_t initial_buffer_size)
+	: initial_buffer_size_(initial_buffer_size), shrink_threshold_(default_shrink_threshold),
+	received_since_drain_(0), read_size_fraction_(0), read_size_min_samples_(0), last_activity_(std::chrono::steady_clock::now()),
+	base_memory_(redis::buffer_pool::block_size(initial_buffer_size) * 2), charged_memory_(0), socket_(io)
 {
+#ifdef __linux__
+	busy_poll_budget_ = std::chrono::microseconds(0);
+	busy_poll_yield_ = false;
+	so_busy_poll_ = 0;
+	kernel_busy_poll_ = false;
+	busy_poll_stats_ = busy_poll_stats();
+	io_time_out_ = 0;
+#endif
 	reset();
 }
 
+asio_stream_adaptor::~asio_stream_adaptor()
+{
+	if (memory_limits_.budget != nullptr && charged_memory_ > 0) {
+		memory_limits_.budget->release(charged_memory_);
+	}
+}
+
 // redis::stream interface implementation
 bool asio_stream_adaptor::close()
 {
@@ -52,6 +140,7 @@ redis::const_buffer_view asio_stream_adaptor::read(size_t n)
 	auto result = ensure_available_buffer(n);
 	if (result.first.valid()) {
 		to_be_read_ = result.second;
+		count_consumed();
 	}
 	return result.first;
 }
@@ -61,6 +150,62 @@ size_t asio_stream_adaptor::skip(size_t n)
 	return read(n).size();
 }
 
+bool asio_stream_adaptor::read_into(redis::buffer_view output)
+{
+	// hand over already buffered data first
+	auto buffered = std::min(output.size(), to_be_read_.size());
+	std::copy(to_be_read_.begin(), to_be_read_.begin() + buffered, output.begin());
+	to_be_read_ = to_be_read_.split(buffered).second;
+
+	auto remaining = redis::buffer_view(output.begin() + buffered, output.end());
+	if (remaining.empty()) {
+		count_consumed();
+		return true;
+	}
+
+	if (remaining.size() < std::max(read_buffer_.size(), initial_buffer_size_)) {
+		// small remainder - go through the read buffer so that following replies are read ahead together
+		auto result = read(remaining.size());
+		if (!result.valid()) {
+			return false;
+		}
+		std::copy(result.begin(), result.end(), remaining.begin());
+		return true;
+	}
+
+	// large remainder - receive directly into the destination without touching the read buffer
+	boost::system::error_code ec;
+	auto size = boost::asio::read(socket_, boost::asio::buffer(remaining.data(), remaining.size()), boost::asio::transfer_all(), ec);
+	if (ec || size < remaining.size()) {
+		err_code_ = ec;
+		return false;
+	}
+
+	received_since_drain_ += size;
+	count_consumed();
+	return true;
+}
+
+bool asio_stream_adaptor::wait_readable(std::chrono::milliseconds timeout)
+{
+	// asio may have switched the socket to non-blocking mode, so wait for it explicitly
+#ifdef _WIN32
+	WSAPOLLFD fd = { socket_.native_handle(), POLLRDNORM, 0 };
+	auto result = ::WSAPoll(&fd, 1, static_cast<INT>(timeout.count()));
+	if (result == SOCKET_ERROR) {
+		err_code_.assign(::WSAGetLastError(), boost::system::system_category());
+	}
+#else
+	pollfd fd = { socket_.native_handle(), POLLIN, 0 };
+	int result = 0;
+	while ((result = ::poll(&fd, 1, static_cast<int>(timeout.count()))) < 0 && errno == EINTR) {}
+	if (result < 0) {
+		err_code_.assign(errno, boost::system::system_category());
+	}
+#endif
+	return result != 0;
+}
+
 // utility functions for read interface
 std::pair<redis::buffer_view, redis::buffer_view> asio_stream_adaptor::ensure_available_buffer(size_t at_least)
 {
@@ -80,7 +225,9 @@ bool asio_stream_adaptor::read_from_socket(size_t at_least)
 {
 	if (to_be_read_.size() == 0 || unused_read_buffer().size() < at_least) {
 		// when the remaining data size is zero, move read view to head of the buffer to reduce the number of copying
-		move_and_ensure_read_buffer(at_least);
+		if (!move_and_ensure_read_buffer(at_least)) {
+			return false;
+		}
 	}
 
 	boost::system::error_code ec;
@@ -88,100 +235,646 @@ bool asio_stream_adaptor::read_from_socket(size_t at_least)
 
 	while (read_byte < at_least) {
 		auto unused = unused_read_buffer();
-		auto result = socket_.read_some(boost::asio::buffer(unused.data(), unused.size()), ec);
-		if (ec || result == 0) {
-			err_code_ = ec;
+		size_t result = 0;
+
+#ifdef __linux__
+		if (busy_poll_budget_.count() > 0 && !busy_poll_read(unused, result)) {
 			return false;
 		}
+#endif
+
+		if (result == 0) {
+			result = socket_.read_some(boost::asio::buffer(unused.data(), unused.size()), ec);
+			if (ec || result == 0) {
+				err_code_ = ec;
+				return false;
+			}
+		}
 
 		read_byte += result;
+		received_since_drain_ += result;
 
 		to_be_read_ = redis::buffer_view(to_be_read_.begin(), to_be_read_.size() + result);
 		assert(read_range_check());		
 	}
 
+	last_activity_ = std::chrono::steady_clock::now();
 	return true;
 }
 	
 redis::buffer_view asio_stream_adaptor::unused_read_buffer()
 {
-	return redis::buffer_view(to_be_read_.end(), read_buffer_.data() + read_buffer_.size());
+	return redis::buffer_view(to_be_read_.end(), read_base() + read_buffer_.size());
 }
 	
-void asio_stream_adaptor::move_and_ensure_read_buffer(size_t at_least)
+bool asio_stream_adaptor::move_and_ensure_read_buffer(size_t at_least)
 {
-	bool need_to_resize = read_buffer_.size() - to_be_read_.size() < at_least;
 	size_t available_size = to_be_read_.size();
+	size_t required = available_size + at_least;
+	size_t preferred = preferred_read_buffer_size();
+	bool adaptive = adaptive_read_buffer();
+
+	// the buffer is allocated on first use, and goes back to the preferred size once a large reply is consumed
+	// with adaptive sizing, it also grows to the preferred size when the budget has the memory at once, and a drained
+	// buffer twice as large is replaced
+	bool need_to_grow = read_buffer_.size() < required;
+	bool want_to_grow = adaptive && !need_to_grow && read_buffer_.size() < preferred && reserve_memory(read_buffer_, preferred, false);
+	bool need_to_shrink = (shrink_threshold_ > 0 && read_buffer_.size() > shrink_threshold_ && required <= shrink_threshold_) ||
+		(adaptive && available_size == 0 && read_buffer_.size() > 2 * preferred && required <= preferred);
 
-	if (need_to_resize) {
-		std::vector<char> swapped(available_size + at_least);
+	if (need_to_grow || want_to_grow || need_to_shrink) {
+		auto size = std::max(required, preferred);
+		if (need_to_grow) {
+			if (memory_limits_.max_read_buffer > 0 && required > memory_limits_.max_read_buffer) {
+				err_code_ = boost::asio::error::no_buffer_space;
+				return false;
+			}
+			if (size > required && !reserve_memory(read_buffer_, size, false)) {
+				size = required; // the budget can not spare the preferred size now
+			}
+			if (!reserve_memory(read_buffer_, size, true)) {
+				err_code_ = boost::asio::error::no_buffer_space;
+				return false;
+			}
+		}
+
+		redis::pooled_buffer swapped(size);
 		std::copy(to_be_read_.begin(), to_be_read_.end(), swapped.begin());
 		read_buffer_.swap(swapped);
+		if (need_to_shrink) {
+			settle_memory();
+		}
 	} else {
 		std::copy(to_be_read_.begin(), to_be_read_.end(), read_buffer_.begin());			
 	}
 
-	to_be_read_ = redis::buffer_view(read_buffer_.data(), available_size);
+	to_be_read_ = redis::buffer_view(read_base(), available_size);
 	assert(read_range_check());
+	return true;
+}
+
+void asio_stream_adaptor::count_consumed()
+{
+	// the end of a read burst is where the buffered input runs out
+	if (to_be_read_.empty() && received_since_drain_ > 0) {
+		read_sizes_.record(received_since_drain_);
+		received_since_drain_ = 0;
+	}
 }
 
 bool asio_stream_adaptor::read_range_check() const
 {
 	return to_be_read_.valid() &&
-		(to_be_read_.begin() >= read_buffer_.data()) &&
-		(to_be_read_.end() <= read_buffer_.data() + read_buffer_.size());
+		(to_be_read_.begin() >= read_base()) &&
+		(to_be_read_.end() <= read_base() + read_buffer_.size());
 }
 
 // redis::stream output interface implementation
 bool asio_stream_adaptor::flush()
 {
+	size_t sent = 0;
+
+#ifdef __linux__
+	// file regions are sent in between the buffered data, at the position they were written
+	for (auto i = pending_files_.begin(), e = pending_files_.end(); i != e; ++i) {
+		if (!write_to_socket(to_be_written_.slice(sent, i->first)) || !send_file_to_socket(i->second)) {
+			return false;
+		}
+		sent = i->first;
+	}
+	pending_files_.clear();
+#endif
+
+	auto result = write_to_socket(to_be_written_.slice(sent, to_be_written_.size()));
+
+#ifdef __linux__
+	if (write_buffer_in_flight_) {
+		// the kernel may still read from the buffer, so continue with another one
+		pin_write_buffer();
+	}
+#endif
+
+	if (!result) {
+		return false;
+	}
+
+	if (shrink_threshold_ > 0 && write_buffer_.size() > shrink_threshold_) {
+		// the large transfer is done - allocate again on demand
+		write_buffer_.release();
+		settle_memory();
+	}
+
+	to_be_written_ = redis::buffer_view(write_base(), size_t(0));
+	assert(write_range_check());
+	last_activity_ = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool asio_stream_adaptor::write_to_socket(redis::const_buffer_view data, bool zero_copy)
+{
+#ifdef __linux__
+	if (zero_copy && zero_copy_threshold_ > 0 && data.size() >= zero_copy_threshold_) {
+		return send_zero_copy(data);
+	}
+#endif
+
 	boost::system::error_code ec;
-	auto size = boost::asio::write(socket_, boost::asio::buffer(to_be_written_.data(), to_be_written_.size()), boost::asio::transfer_all(), ec);
+	auto size = boost::asio::write(socket_, boost::asio::buffer(data.data(), data.size()), boost::asio::transfer_all(), ec);
 
-	assert(size == to_be_written_.size()); // because of transfer_all
+	assert(ec || size == data.size()); // because of transfer_all
 
-	if (ec || size < to_be_written_.size()) {
+	if (ec || size < data.size()) {
 		err_code_ = ec;
 		return false;
+	}
+	return true;
+}
+
+#ifdef __linux__
+bool asio_stream_adaptor::write_file(const redis::file_region& region)
+{
+	// the region is sent by sendfile at flush time, without copying it into the write buffer
+	pending_files_.emplace_back(to_be_written_.size(), region);
+	return true;
+}
+
+bool asio_stream_adaptor::send_file_to_socket(const redis::file_region& region)
+{
+	off_t offset = static_cast<off_t>(region.offset);
+	size_t remaining = region.length;
+
+	while (remaining > 0) {
+		auto result = ::sendfile(socket_.native_handle(), region.fd, &offset, remaining);
+		if (result > 0) {
+			remaining -= static_cast<size_t>(result);
+		} else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!wait_socket(POLLOUT)) {
+				return false;
+			}
+		} else if (result < 0 && errno == EINTR) {
+			continue;
+		} else { // error or unexpected end of file
+			err_code_.assign(result < 0 ? errno : EIO, boost::system::system_category());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool asio_stream_adaptor::wait_socket(short events)
+{
+	// asio may have switched the socket to non-blocking mode, so wait for it explicitly
+	// the wait is bounded by the time-out of the connection, as blocking sends are by SO_SNDTIMEO
+	pollfd fd = { socket_.native_handle(), events, 0 };
+	int timeout = io_time_out_ > 0 ? static_cast<int>(std::min<int64_t>(int64_t(io_time_out_) * 1000, INT_MAX)) : -1;
+	auto result = ::poll(&fd, 1, timeout);
+	if (result < 0 && errno != EINTR) {
+		err_code_.assign(errno, boost::system::system_category());
+		return false;
+	}
+	if (result == 0) { // a stalled peer
+		err_code_ = boost::asio::error::timed_out;
+		return false;
+	}
+	return true;
+}
+
+bool asio_stream_adaptor::enable_zero_copy(size_t threshold)
+{
+	if (!socket_.is_open()) {
+		err_code_ = boost::asio::error::not_connected;
+		return false;
+	}
+
+	int enabled = 1;
+	if (::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &enabled, sizeof(enabled)) < 0) {
+		err_code_.assign(errno, boost::system::system_category());
+		return false;
+	}
+
+	zero_copy_threshold_ = std::max<size_t>(threshold, 1);
+	return true;
+}
+
+bool asio_stream_adaptor::send_zero_copy(redis::const_buffer_view data)
+{
+	size_t sent = 0;
+
+	while (sent < data.size()) {
+		auto result = ::send(socket_.native_handle(), data.data() + sent, data.size() - sent, MSG_ZEROCOPY | MSG_NOSIGNAL);
+		if (result > 0) {
+			// each successful send gets the next completion id of the socket
+			if (!write_buffer_in_flight_) {
+				write_buffer_in_flight_ = true;
+				write_buffer_first_id_ = zero_copy_next_id_;
+			}
+			++zero_copy_next_id_;
+			sent += static_cast<size_t>(result);
+		} else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!wait_socket(POLLOUT)) {
+				return false;
+			}
+		} else if (result < 0 && errno == ENOBUFS) {
+			// too many pages are pinned for this socket - wait until some of them are released
+			if (!reap_zero_copy_completions(true)) {
+				return false;
+			}
+		} else if (result < 0 && errno == EINTR) {
+			continue;
+		} else {
+			err_code_.assign(result < 0 ? errno : EIO, boost::system::system_category());
+			return false;
+		}
+	}
+	return true;
+}
+
+void asio_stream_adaptor::pin_write_buffer()
+{
+	pinned_buffer pinned;
+	pinned.buffer.swap(write_buffer_);
+	pinned.first_id = write_buffer_first_id_;
+	pinned.pending = zero_copy_next_id_ - write_buffer_first_id_;
+	pinned_buffers_.push_back(std::move(pinned));
+	write_buffer_in_flight_ = false;
+
+	reap_zero_copy_completions(false);
+	while (pinned_buffers_.size() > max_pinned_buffers) {
+		if (!reap_zero_copy_completions(true)) {
+			break;
+		}
+	}
+
+	if (!spare_buffers_.empty()) {
+		write_buffer_.swap(spare_buffers_.back());
+		spare_buffers_.pop_back();
 	} else {
-		to_be_written_ = redis::buffer_view(write_buffer_.data(), 0u);
-		assert(write_range_check());
+		write_buffer_.resize(pinned_buffers_.empty() ? initial_buffer_size_ : pinned_buffers_.back().buffer.size());
+	}
+	to_be_written_ = redis::buffer_view(write_base(), size_t(0));
+	settle_memory(); // pinned buffers are bounded by their count, not by the budget
+}
+
+bool asio_stream_adaptor::reap_zero_copy_completions(bool wait)
+{
+	bool reaped = false;
+
+	for (;;) {
+		char control[128];
+		msghdr msg = {};
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (::recvmsg(socket_.native_handle(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait && !reaped && !pinned_buffers_.empty()) {
+				// an empty event mask still reports POLLERR, which means the error queue is readable
+				if (!wait_socket(0)) {
+					return false;
+				}
+				continue;
+			}
+			return reaped;
+		}
+
+		for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+				!(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+				continue;
+			}
+			auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+			if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+				complete_zero_copy(err->ee_info, err->ee_data);
+				reaped = true;
+			}
+		}
+	}
+}
+
+bool asio_stream_adaptor::enable_busy_poll(std::chrono::microseconds budget, bool yield, int so_busy_poll)
+{
+	busy_poll_budget_ = std::max(budget, std::chrono::microseconds(0));
+	busy_poll_yield_ = yield;
+	so_busy_poll_ = so_busy_poll;
+	return socket_.is_open() ? apply_busy_poll_option() : true;
+}
+
+bool asio_stream_adaptor::apply_busy_poll_option()
+{
+	kernel_busy_poll_ = false;
+	if (so_busy_poll_ <= 0) {
 		return true;
 	}
+
+	if (::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &so_busy_poll_, sizeof(so_busy_poll_)) < 0) {
+		if (errno == EPERM) {
+			// not allowed above net.core.busy_read without CAP_NET_ADMIN - spinning in user space still works
+			return true;
+		}
+		err_code_.assign(errno, boost::system::system_category());
+		return false;
+	}
+
+	kernel_busy_poll_ = true;
+	return true;
+}
+
+bool asio_stream_adaptor::busy_poll_read(redis::buffer_view unused, size_t& received)
+{
+	// 'received' stays zero when nothing arrived within the budget, then the caller blocks as usual
+	auto deadline = std::chrono::steady_clock::now() + busy_poll_budget_;
+	received = 0;
+
+	do {
+		auto result = ::recv(socket_.native_handle(), unused.data(), unused.size(), MSG_DONTWAIT);
+		++busy_poll_stats_.spins;
+
+		if (result > 0) {
+			++busy_poll_stats_.hits;
+			received = static_cast<size_t>(result);
+			return true;
+		} else if (result == 0) {
+			err_code_ = boost::asio::error::eof;
+			return false;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			err_code_.assign(errno, boost::system::system_category());
+			return false;
+		}
+
+		if (busy_poll_yield_) {
+			std::this_thread::yield();
+			++busy_poll_stats_.yields;
+		}
+	} while (std::chrono::steady_clock::now() < deadline);
+
+	++busy_poll_stats_.misses;
+	return true;
+}
+
+void asio_stream_adaptor::complete_zero_copy(uint32_t first_id, uint32_t last_id)
+{
+	for (auto i = pinned_buffers_.begin(); i != pinned_buffers_.end();) {
+		// ids are compared relative to the first id of each buffer to survive the wrap around
+		auto lo = std::max<int64_t>(static_cast<int32_t>(first_id - i->first_id), 0);
+		auto hi = std::min<int64_t>(static_cast<int32_t>(last_id - i->first_id), int64_t(i->pending) - 1);
+		if (hi >= lo) {
+			i->pending -= static_cast<uint32_t>(hi - lo + 1);
+		}
+
+		if (i->pending == 0) {
+			if (spare_buffers_.size() < max_spare_buffers) {
+				spare_buffers_.push_back(std::move(i->buffer));
+			}
+			i = pinned_buffers_.erase(i);
+		} else {
+			++i;
+		}
+	}
 }
+#endif
 
 bool asio_stream_adaptor::write(redis::const_buffer_view input)
 {
 	if (input.size() > unused_write_buffer().size()) {
-		write_buffer_.resize(std::max(to_be_written_.size() + input.size(), write_buffer_.size() * 2));
-		to_be_written_ = redis::buffer_view(write_buffer_.data(), to_be_written_.size());
+		auto size = std::max({ to_be_written_.size() + input.size(), write_buffer_.size() * 2, initial_buffer_size_ });
+		if (memory_limits_.max_write_buffer > 0) {
+			size = std::min(size, std::max(memory_limits_.max_write_buffer, write_buffer_.size()));
+		}
+
+		if (to_be_written_.size() + input.size() > size || !reserve_memory(write_buffer_, size, false)) {
+			return write_unbuffered(input);
+		}
+
+		write_buffer_.resize(size);
+		to_be_written_ = redis::buffer_view(write_base(), to_be_written_.size());
 	}
 
 	assert(input.size() <= unused_write_buffer().size());
 	std::copy(input.begin(), input.end(), unused_write_buffer().begin());
-	to_be_written_ = redis::buffer_view(write_buffer_.data(), to_be_written_.size() + input.size());
+	to_be_written_ = redis::buffer_view(write_base(), to_be_written_.size() + input.size());
 
 	return true;
 }
 
+bool asio_stream_adaptor::write_unbuffered(redis::const_buffer_view input)
+{
+	// backpressure - send what is buffered instead of growing the buffer
+	if (!flush()) {
+		return false;
+	}
+
+	if (input.size() <= unused_write_buffer().size()) {
+		std::copy(input.begin(), input.end(), unused_write_buffer().begin());
+		to_be_written_ = redis::buffer_view(write_base(), to_be_written_.size() + input.size());
+		return true;
+	}
+
+	// the caller may reuse the input at once, so it is never sent with MSG_ZEROCOPY
+	return write_to_socket(input, false);
+}
+
+size_t asio_stream_adaptor::pending_output() const
+{
+	size_t size = to_be_written_.size();
+#ifdef __linux__
+	for (auto i = pending_files_.begin(), e = pending_files_.end(); i != e; ++i) {
+		size += i->second.length;
+	}
+#endif
+	return size;
+}
+
 bool asio_stream_adaptor::write_range_check() const
 {
 	return to_be_written_.valid() &&
-		(to_be_written_.begin() >= write_buffer_.data()) &&
-		(to_be_written_.end() <= write_buffer_.data() + write_buffer_.size());
+		(to_be_written_.begin() >= write_base()) &&
+		(to_be_written_.end() <= write_base() + write_buffer_.size());
 }
 
 redis::buffer_view asio_stream_adaptor::unused_write_buffer()
 {
-	return redis::buffer_view(to_be_written_.end(), write_buffer_.data() + write_buffer_.size());
+	return redis::buffer_view(to_be_written_.end(), write_base() + write_buffer_.size());
+}
+
+// utility functions for memory limits
+bool asio_stream_adaptor::reserve_memory(const redis::pooled_buffer& replaced, size_t new_size, bool wait)
+{
+	// only the memory beyond the initial buffers is charged, by the pooled blocks the buffers take
+	auto total = read_buffer_.capacity() + write_buffer_.capacity() - replaced.capacity() + redis::buffer_pool::block_size(new_size);
+	auto charge = total > base_memory_ ? total - base_memory_ : 0;
+	if (memory_limits_.budget == nullptr || charge <= charged_memory_) {
+		return true;
+	}
+
+	auto budget = memory_limits_.budget;
+	auto acquired = wait ? budget->acquire(charge - charged_memory_, memory_limits_.budget_wait) : budget->try_acquire(charge - charged_memory_);
+	if (acquired) {
+		charged_memory_ = charge;
+	}
+	return acquired;
+}
+
+void asio_stream_adaptor::settle_memory()
+{
+	if (memory_limits_.budget == nullptr) {
+		return;
+	}
+
+	// brings the charge in line with the buffers after they shrank or were replaced
+	auto total = read_buffer_.capacity() + write_buffer_.capacity();
+	auto charge = total > base_memory_ ? total - base_memory_ : 0;
+	if (charge < charged_memory_) {
+		memory_limits_.budget->release(charged_memory_ - charge);
+		charged_memory_ = charge;
+	} else if (charge > charged_memory_ && memory_limits_.budget->try_acquire(charge - charged_memory_)) {
+		charged_memory_ = charge;
+	}
 }
 
 // asio_stream_adaptor member functions
+void asio_stream_adaptor::set_memory_limits(const memory_limits& limits)
+{
+	if (memory_limits_.budget != nullptr && charged_memory_ > 0) {
+		memory_limits_.budget->release(charged_memory_);
+	}
+	charged_memory_ = 0;
+
+	memory_limits_ = limits;
+	settle_memory();
+}
+
 void asio_stream_adaptor::reset()
 {
-	to_be_read_ = redis::buffer_view(read_buffer_.data(), 0u);
-	to_be_written_ = redis::buffer_view(write_buffer_.data(), 0u);
-	move_and_ensure_read_buffer(0);
+	// a closed connection keeps no buffers
+	read_buffer_.release();
+	write_buffer_.release();
+	to_be_read_ = redis::buffer_view(read_base(), size_t(0));
+	to_be_written_ = redis::buffer_view(write_base(), size_t(0));
+	received_since_drain_ = 0;
+#ifdef __linux__
+	pending_files_.clear();
+	zero_copy_threshold_ = 0; // SO_ZEROCOPY should be enabled again for a new socket
+	zero_copy_next_id_ = 0;
+	write_buffer_in_flight_ = false;
+	pinned_buffers_.clear();
+	spare_buffers_.clear();
+	kernel_busy_poll_ = false;
+#endif
+	settle_memory();
+}
+
+void asio_stream_adaptor::set_shrink_threshold(size_t threshold)
+{
+	shrink_threshold_ = threshold;
+}
+
+void asio_stream_adaptor::enable_adaptive_read_buffer(double fraction, size_t min_samples)
+{
+	read_size_fraction_ = fraction;
+	read_size_min_samples_ = min_samples;
+}
+
+bool asio_stream_adaptor::adaptive_read_buffer() const
+{
+	return read_size_fraction_ > 0 && read_sizes_.samples() >= std::max<size_t>(read_size_min_samples_, 1);
+}
+
+size_t asio_stream_adaptor::preferred_read_buffer_size() const
+{
+	if (!adaptive_read_buffer()) {
+		return initial_buffer_size_;
+	}
+
+	// buffers below the smallest pooled block would not save memory
+	auto size = std::max(read_sizes_.percentile(read_size_fraction_), redis::buffer_pool::min_block_size);
+	if (shrink_threshold_ > 0) {
+		size = std::min(size, shrink_threshold_);
+	}
+	if (memory_limits_.max_read_buffer > 0) {
+		size = std::min(size, memory_limits_.max_read_buffer);
+	}
+	return size;
+}
+
+size_t asio_stream_adaptor::release_idle_buffers(std::chrono::steady_clock::duration idle)
+{
+	if (!to_be_read_.empty() || !to_be_written_.empty() || std::chrono::steady_clock::now() - last_activity_ < idle) {
+		return 0;
+	}
+#ifdef __linux__
+	if (!pending_files_.empty()) {
+		return 0;
+	}
+	spare_buffers_.clear();
+#endif
+
+	auto before = buffer_memory();
+	read_buffer_.release();
+	write_buffer_.release();
+	to_be_read_ = redis::buffer_view(read_base(), size_t(0));
+	to_be_written_ = redis::buffer_view(write_base(), size_t(0));
+	settle_memory();
+	return before - buffer_memory();
+}
+
+size_t asio_stream_adaptor::buffer_memory() const
+{
+	size_t size = read_buffer_.capacity() + write_buffer_.capacity();
+#ifdef __linux__
+	for (auto i = pinned_buffers_.begin(), e = pinned_buffers_.end(); i != e; ++i) {
+		size += i->buffer.capacity();
+	}
+	for (auto i = spare_buffers_.begin(), e = spare_buffers_.end(); i != e; ++i) {
+		size += i->capacity();
+	}
+#endif
+	return size;
+}
+
+asio_resolver_cache::asio_resolver_cache(std::chrono::seconds ttl)
+	: ttl_(ttl), resolutions_(0)
+{
+}
+
+bool asio_resolver_cache::resolve(const std::string& host, uint16_t port, boost::asio::ip::tcp::endpoint& endpoint, boost::system::error_code& err)
+{
+	auto key = std::make_pair(host, port);
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto i = entries_.find(key);
+		if (i != entries_.end() && i->second.expires > now) {
+			endpoint = i->second.endpoint;
+			return true;
+		}
+	}
+
+	// resolved outside the lock, so that lookups of other hosts do not wait for it
+	auto result = resolve_endpoint(host, port, endpoint, err);
+
+	std::lock_guard<std::mutex> guard(lock_);
+	resolutions_++;
+	if (!result) {
+		return false;
+	}
+
+	entry resolved = { endpoint, now + ttl_ };
+	entries_[key] = resolved;
+	return true;
+}
+
+void asio_resolver_cache::clear()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	entries_.clear();
+}
+
+size_t asio_resolver_cache::resolutions() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return resolutions_;
 }
 
 bool asio_stream_adaptor::connect(const std::string& ip, uint16_t port, int32_t time_out)
@@ -191,63 +884,249 @@ bool asio_stream_adaptor::connect(const std::string& ip, uint16_t port, int32_t
 		return false;
 	}
 
-	if (!connect_with_time_out(ip, port, time_out)) {
+	boost::asio::ip::tcp::endpoint endpoint;
+	if (!resolve_endpoint(ip, port, endpoint, err_code_)) {
 		return false;
 	}
-		
-	if (::setsockopt(socket_.native(), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&time_out), sizeof(time_out)) == SOCKET_ERROR ||
-		::setsockopt(socket_.native(), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&time_out), sizeof(time_out)) == SOCKET_ERROR) {
-		err_code_.assign(::WSAGetLastError(), boost::system::system_category());
-		close();
+
+	return connect_to(endpoint, time_out) && setup_socket(time_out);
+}
+
+bool asio_stream_adaptor::connect(const std::string& ip, uint16_t port, asio_resolver_cache& cache, int32_t time_out)
+{
+	if (socket_.is_open()) {
+		err_code_ = boost::asio::error::already_connected;
 		return false;
 	}
-	return true;
+
+	boost::asio::ip::tcp::endpoint endpoint;
+	if (!cache.resolve(ip, port, endpoint, err_code_)) {
+		return false;
+	}
+
+	return connect_to(endpoint, time_out) && setup_socket(time_out);
 }
 
-bool asio_stream_adaptor::connect_with_time_out(const std::string& ip, uint16_t port, int32_t time_out)
+asio_stream_adaptor::connect_report asio_stream_adaptor::connect_all(const std::vector<connect_target>& targets, int32_t time_out, asio_resolver_cache* cache)
 {
 	using boost::asio::ip::tcp;
-	using boost::asio::deadline_timer;
+	typedef std::chrono::steady_clock clock;
 
-	tcp::resolver resolver(io_service);
-	tcp::resolver::query query(ip, boost::lexical_cast<std::string>(port)); // v6?
+	asio_resolver_cache local_cache;
+	if (cache == nullptr) {
+		cache = &local_cache;
+	}
 
-	boost::system::error_code err;
+	connect_report report;
+	auto resolutions = cache->resolutions();
+	auto start = clock::now();
 
-	auto iterator = resolver.resolve(query, err);
-	if (err) {
-		err_code_ = err;
+	// resolve phase : a host shared by targets is looked up once
+	std::vector<tcp::endpoint> endpoints(targets.size());
+	std::vector<bool> started(targets.size(), false);
+	for (size_t i = 0; i < targets.size(); i++) {
+		auto stream = targets[i].stream;
+		if (stream->socket_.is_open()) {
+			stream->err_code_ = boost::asio::error::already_connected;
+		} else {
+			started[i] = cache->resolve(targets[i].host, targets[i].port, endpoints[i], stream->err_code_);
+		}
+	}
+
+	report.resolutions = cache->resolutions() - resolutions;
+	auto resolved = clock::now();
+	report.resolve_time = resolved - start;
+
+	// connect phase : every connect is in flight at once, and they share one deadline
+	std::vector<asio_stream_adaptor*> connecting;
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (started[i] && targets[i].stream->start_connect(endpoints[i])) {
+			connecting.push_back(targets[i].stream);
+		}
+	}
+	finish_connects(connecting, clock::now() + std::chrono::seconds(time_out));
+
+	auto connected = clock::now();
+	report.connect_time = connected - resolved;
+
+	// setup phase
+	for (size_t i = 0; i < targets.size(); i++) {
+		auto stream = targets[i].stream;
+		if (started[i] && stream->socket_.is_open() && stream->setup_socket(time_out)) {
+			report.connected++;
+		} else {
+			report.failed++;
+		}
+	}
+
+	report.setup_time = clock::now() - connected;
+	return report;
+}
+
+bool asio_stream_adaptor::connect_to(const boost::asio::ip::tcp::endpoint& endpoint, int32_t time_out)
+{
+	if (!start_connect(endpoint)) {
 		return false;
 	}
 
-	deadline_timer t(socket_.get_io_service());
+	std::vector<asio_stream_adaptor*> connecting(1, this);
+	finish_connects(connecting, std::chrono::steady_clock::now() + std::chrono::seconds(time_out));
 
-	bool error_occurred = false;
+	// a failed connect closes the socket
+	return socket_.is_open();
+}
 
-	t.expires_from_now(boost::posix_time::seconds(time_out));
-	t.async_wait([this, &error_occurred](const boost::system::error_code& ec) {
-		if (ec != boost::asio::error::operation_aborted) {
-			err_code_ = boost::asio::error::timed_out;
-			error_occurred = true;
-			close();
+// connects are non-blocking and waited for with poll, instead of running an io_service - the global one is shared
+// by the threads which connect at the same time, and running it from one of them may complete the connects of others
+bool asio_stream_adaptor::start_connect(const boost::asio::ip::tcp::endpoint& endpoint)
+{
+	boost::system::error_code error;
+	socket_.open(endpoint.protocol(), error);
+	if (!error) {
+		socket_.non_blocking(true, error);
+	}
+
+	if (!error && ::connect(socket_.native_handle(), endpoint.data(), static_cast<socklen_t>(endpoint.size())) != 0) {
+#ifdef _WIN32
+		auto code = ::WSAGetLastError();
+		if (code != WSAEWOULDBLOCK) {
+			error.assign(code, boost::system::system_category());
 		}
-	});
+#else
+		if (errno != EINPROGRESS && errno != EINTR) {
+			error.assign(errno, boost::system::system_category());
+		}
+#endif
+	}
 
-	socket_.async_connect(iterator->endpoint(), [this, &t, &error_occurred](const boost::system::error_code& ec) {
-		if (!socket_.is_open()) { // time out
-			// already handled in the timer callback
-		} else if (!ec) {  // no error
-			t.cancel();				
-		} else { // connection error
-			err_code_ = ec;
-			error_occurred = true;
-			close();
+	if (error) {
+		close(); // which overwrites err_code_
+		err_code_ = error;
+		return false;
+	}
+	return true;
+}
+
+void asio_stream_adaptor::finish_connects(std::vector<asio_stream_adaptor*>& connecting, std::chrono::steady_clock::time_point deadline)
+{
+#ifdef _WIN32
+	std::vector<WSAPOLLFD> fds;
+	const short events = POLLWRNORM;
+#else
+	std::vector<pollfd> fds;
+	const short events = POLLOUT;
+#endif
+
+	while (!connecting.empty()) {
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0) {
+			for (auto stream : connecting) {
+				stream->close();
+				stream->err_code_ = boost::asio::error::timed_out;
+			}
+			return;
+		}
+
+		fds.clear();
+		for (auto stream : connecting) {
+			fds.push_back({ stream->socket_.native_handle(), events, 0 });
+		}
+
+		// a connect is done when its socket becomes writable, successfully or not
+		boost::system::error_code error;
+#ifdef _WIN32
+		if (::WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), static_cast<INT>(remaining.count())) == SOCKET_ERROR) {
+			error.assign(::WSAGetLastError(), boost::system::system_category());
+		}
+#else
+		if (::poll(fds.data(), fds.size(), static_cast<int>(std::min<int64_t>(remaining.count(), INT_MAX))) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error.assign(errno, boost::system::system_category());
 		}
-	});
+#endif
 
-	while(socket_.get_io_service().run_one()) {}
+		if (error) {
+			for (auto stream : connecting) {
+				stream->close();
+				stream->err_code_ = error;
+			}
+			return;
+		}
 
-	return !error_occurred;
+		size_t pending = 0;
+		for (size_t i = 0; i < connecting.size(); i++) {
+			if (fds[i].revents != 0) {
+				connecting[i]->finish_connect();
+			} else {
+				connecting[pending++] = connecting[i];
+			}
+		}
+		connecting.resize(pending);
+	}
+}
+
+bool asio_stream_adaptor::finish_connect()
+{
+	int code = 0;
+	socklen_t length = sizeof(code);
+	boost::system::error_code error;
+
+	if (::getsockopt(socket_.native_handle(), SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&code), &length) != 0) {
+#ifdef _WIN32
+		code = ::WSAGetLastError();
+#else
+		code = errno;
+#endif
+	}
+
+	if (code != 0) {
+		error.assign(code, boost::system::system_category());
+	} else {
+		socket_.non_blocking(false, error); // asio blocks on the socket for the synchronous reads and writes
+	}
+
+	if (error) {
+		close(); // which overwrites err_code_
+		err_code_ = error;
+		return false;
+	}
+	return true;
+}
+
+bool asio_stream_adaptor::setup_socket(int32_t time_out)
+{
+	boost::system::error_code error;
+
+#ifdef _WIN32
+	if (::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&time_out), sizeof(time_out)) == SOCKET_ERROR ||
+		::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&time_out), sizeof(time_out)) == SOCKET_ERROR) {
+		error.assign(::WSAGetLastError(), boost::system::system_category());
+	}
+#else
+	// the time-outs take a timeval outside Windows
+	timeval tv = {};
+	tv.tv_sec = time_out;
+	if (::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0 ||
+		::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+		error.assign(errno, boost::system::system_category());
+	}
+#endif
+
+#ifdef __linux__
+	io_time_out_ = time_out;
+	if (!error && !apply_busy_poll_option()) {
+		error = err_code_;
+	}
+#endif
+
+	if (error) {
+		close(); // which overwrites err_code_
+		err_code_ = error;
+		return false;
+	}
+	return true;
 }
 
 /*
@@ -2,12 +2,57 @@
 #define REDIS_ASIO_ADAPTOR_H
 
 #include <vector>
+#include <deque>
+#include <map>
+#include <string>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include <system_error>
+#include <boost/version.hpp>
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/system/error_code.hpp>
 
 #include "redis_base.h"
+#include "reply_scanner.h"
+#include "memory_budget.h"
+#include "buffer_pool.h"
+#include "reply_size_histogram.h"
+
+// completion tokens (async_initiate) are available since Boost 1.70
+#if BOOST_VERSION >= 107000
+#define REDIS_ASIO_ASYNC_REQUEST 1
+#endif
+
+// resolved endpoints by host and port, so that connections to the same host resolve it once
+// an entry is resolved again after 'ttl', failed resolutions are not cached
+// thread-safety : safe in shared
+class asio_resolver_cache
+{
+public:
+	asio_resolver_cache(std::chrono::seconds ttl = std::chrono::seconds(60));
+
+	bool resolve(const std::string& host, uint16_t port, boost::asio::ip::tcp::endpoint& endpoint, boost::system::error_code& err);
+	void clear();
+
+	// lookups answered by the resolver, instead of the cache
+	size_t resolutions() const;
+
+private:
+	struct entry
+	{
+		boost::asio::ip::tcp::endpoint endpoint;
+		std::chrono::steady_clock::time_point expires;
+	};
+
+	std::chrono::seconds ttl_;
+	mutable std::mutex lock_;
+	std::map<std::pair<std::string, uint16_t>, entry> entries_;
+	size_t resolutions_;
+};
 
 // thread-safety : safe in distinct, not safe in shared
 struct asio_stream_adaptor : public redis::stream
@@ -15,9 +60,11 @@ struct asio_stream_adaptor : public redis::stream
 public:
 	asio_stream_adaptor(size_t initial_buffer_size = 16384);
 
-	~asio_stream_adaptor()
-	{
-	}
+	// the socket runs on the given io_service instead of the adaptor's own one, which async_request needs
+	// connect does not run the io_service, so other threads may run it meanwhile
+	asio_stream_adaptor(boost::asio::io_service& io, size_t initial_buffer_size = 16384);
+
+	~asio_stream_adaptor();
 
 	// redis::stream interface implementation
 	virtual bool close() override;
@@ -28,25 +75,209 @@ public:
 	virtual redis::const_buffer_view peek(size_t n) override;
 	virtual redis::const_buffer_view read(size_t n) override;
 	virtual size_t skip(size_t n) override;
+	virtual bool read_into(redis::buffer_view output) override;
+	virtual bool wait_readable(std::chrono::milliseconds timeout) override;
 
 	// redis::stream output interface implementation
 	virtual bool flush() override;
 	virtual bool write(redis::const_buffer_view input) override;
+	virtual size_t pending_output() const override;
+#ifdef __linux__
+	virtual bool write_file(const redis::file_region& region) override;
+#endif
 
 	// asio_stream_adaptor member functions
 	bool connect(const std::string& ip, uint16_t port, int32_t time_out = 5);
+	bool connect(const std::string& ip, uint16_t port, asio_resolver_cache& cache, int32_t time_out = 5);
+
+	// bulk connect for startup : every host is resolved once through 'cache' (a local one when nullptr), then all
+	// sockets connect at once and share the deadline of 'time_out' seconds
+	// each stream should be closed, a stream which failed reports why in stream_error
+	// like connect, it waits for the sockets with poll instead of running their io_services, so it is safe to call
+	// from many threads at once
+	struct connect_target
+	{
+		asio_stream_adaptor* stream;
+		std::string host;
+		uint16_t port;
+	};
+
+	struct connect_report
+	{
+		connect_report() : resolve_time(0), connect_time(0), setup_time(0), resolutions(0), connected(0), failed(0) {}
+
+		std::chrono::steady_clock::duration resolve_time;
+		std::chrono::steady_clock::duration connect_time;
+		std::chrono::steady_clock::duration setup_time; // of the socket options
+		size_t resolutions; // lookups not answered by the cache
+		size_t connected;
+		size_t failed;
+	};
+
+	static connect_report connect_all(const std::vector<connect_target>& targets, int32_t time_out = 5, asio_resolver_cache* cache = nullptr);
+
 	boost::system::error_code stream_error() const
 	{
 		return err_code_;
 	}
 
+	// bounds of the buffer memory of the connection, zero (or nullptr) means unlimited
+	// buffered commands are flushed before the write buffer grows beyond 'max_write_buffer', and a command which does
+	// not fit is sent without buffering it - so pipelined writers block on the socket instead of growing the buffer
+	// a reply which needs a read buffer larger than 'max_read_buffer' fails the read with no_buffer_space
+	// buffer memory beyond the initial buffers is acquired from 'budget', shared by connections - writes flush instead
+	// of waiting for it, reads wait up to 'budget_wait' before they fail
+	struct memory_limits
+	{
+		memory_limits() : max_write_buffer(0), max_read_buffer(0), budget(nullptr), budget_wait(std::chrono::milliseconds(1000)) {}
+
+		size_t max_write_buffer;
+		size_t max_read_buffer;
+		redis::memory_budget* budget; // should outlive the adaptor
+		std::chrono::milliseconds budget_wait;
+	};
+
+	void set_memory_limits(const memory_limits& limits);
+
+	// bytes currently acquired from the budget - the pooled blocks of the buffers, as buffer_memory counts them
+	size_t charged_memory() const
+	{
+		return charged_memory_;
+	}
+
+	// the buffers are allocated on first use and released by close
+	// a buffer grown beyond 'threshold' by a large transfer is released once the transfer completes, zero keeps it
+	void set_shrink_threshold(size_t threshold);
+
+	// releases the buffers when nothing is buffered and the connection had no I/O for 'idle' - for an owner of many
+	// mostly idle connections to call now and then, returns the number of released bytes
+	size_t release_idle_buffers(std::chrono::steady_clock::duration idle);
+
+	// heap memory held by the buffers of the connection
+	size_t buffer_memory() const;
+
+	// adaptive read buffer : the size of every read burst (the bytes received until the buffered input is consumed -
+	// a reply, or the replies of a pipeline) is tracked, and after 'min_samples' bursts the read buffer is sized to hold
+	// 'fraction' of them instead of the initial size, within the shrink threshold and 'max_read_buffer'
+	// the buffer grows to that size at once, so a large reply takes fewer read_some calls, and a drained buffer twice
+	// as large is replaced by a smaller one, so a connection of small replies holds a small buffer
+	// a zero fraction turns the sizing off, the bursts are tracked either way
+	void enable_adaptive_read_buffer(double fraction = 0.9, size_t min_samples = 16);
+	size_t preferred_read_buffer_size() const;
+	const redis::reply_size_histogram& read_sizes() const
+	{
+		return read_sizes_;
+	}
+
+#ifdef REDIS_ASIO_ASYNC_REQUEST
+	// writes the command and parses its reply into 'handler' without blocking the calling thread
+	// 'token' is a completion token for void(std::error_code) - a callback, boost::asio::use_future or boost::asio::use_awaitable
+	// the reply is read with async_read_some until reply_scanner finds its end, then the buffered reply is parsed
+	// the adaptor, the command and the handler should outlive the operation, and one request at a time may be in flight
+	// commands with file_region arguments are not supported here
+	template<typename command_type, typename CompletionToken>
+	auto async_request(command_type& cmd, CompletionToken&& token)
+	{
+		return async_request(cmd, cmd.reply, std::forward<CompletionToken>(token));
+	}
+
+	template<typename CompletionToken>
+	auto async_request(const redis::command& cmd, redis::reply_handler& handler, CompletionToken&& token)
+	{
+		return boost::asio::async_initiate<CompletionToken, void(std::error_code)>(
+			async_request_initiation(), token, this, &cmd, &handler);
+	}
+#endif
+
+#ifdef __linux__
+	// sends flushed data segments of at least 'threshold' bytes with MSG_ZEROCOPY - call it after connect
+	// flushed write buffers stay pinned until the kernel reports their completion, and then they are reused
+	bool enable_zero_copy(size_t threshold = 262144);
+	size_t pinned_buffer_count() const
+	{
+		return pinned_buffers_.size();
+	}
+
+	// low-latency receive mode : spins on non-blocking recv for up to 'budget' before blocking in read
+	// 'yield' gives up the time slice between spins, non-zero 'so_busy_poll' sets SO_BUSY_POLL (in microseconds)
+	// a value above net.core.busy_read needs CAP_NET_ADMIN - without it only the spin is used, see kernel_busy_poll
+	// a zero budget turns the mode off
+	struct busy_poll_stats
+	{
+		uint64_t spins;  // non-blocking recv calls
+		uint64_t yields; // time slices given up between spins
+		uint64_t hits;   // reads satisfied while spinning
+		uint64_t misses; // reads fallen back to blocking after the budget
+	};
+
+	bool enable_busy_poll(std::chrono::microseconds budget, bool yield = false, int so_busy_poll = 0);
+	const busy_poll_stats& busy_poll_statistics() const
+	{
+		return busy_poll_stats_;
+	}
+	void reset_busy_poll_statistics()
+	{
+		busy_poll_stats_ = busy_poll_stats();
+	}
+	// whether SO_BUSY_POLL is set on the socket
+	bool kernel_busy_poll() const
+	{
+		return kernel_busy_poll_;
+	}
+#endif
+
 private:
+#ifdef REDIS_ASIO_ASYNC_REQUEST
+	template<typename Handler>
+	struct async_request_op
+	{
+		asio_stream_adaptor* self;
+		redis::reply_handler* handler;
+		Handler completion;
+		redis::reply_scanner scanner;
+		bool reading;
+
+		void start(const redis::command& cmd);
+		void operator()(const boost::system::error_code& ec, size_t transferred);
+		void continue_reading();
+		void complete(std::error_code ec, bool immediately);
+	};
+
+	struct async_request_initiation
+	{
+		template<typename Handler>
+		void operator()(Handler&& completion, asio_stream_adaptor* self, const redis::command* cmd, redis::reply_handler* handler) const
+		{
+			async_request_op<typename std::decay<Handler>::type> op = { self, handler, std::forward<Handler>(completion), redis::reply_scanner(), false };
+			op.start(*cmd);
+		}
+	};
+#endif
+
 	// utility functions
 	void reset();
 
 	std::pair<redis::buffer_view, redis::buffer_view> ensure_available_buffer(size_t at_least);
 	bool read_from_socket(size_t at_least);		
-	void move_and_ensure_read_buffer(size_t at_least);
+	bool move_and_ensure_read_buffer(size_t at_least);
+	void count_consumed();
+	bool adaptive_read_buffer() const;
+
+	bool write_to_socket(redis::const_buffer_view data, bool zero_copy = true);
+	bool write_unbuffered(redis::const_buffer_view input);
+
+	bool reserve_memory(const redis::pooled_buffer& replaced, size_t new_size, bool wait);
+	void settle_memory();
+#ifdef __linux__
+	bool send_file_to_socket(const redis::file_region& region);
+	bool send_zero_copy(redis::const_buffer_view data);
+	bool wait_socket(short events);
+	void pin_write_buffer();
+	bool reap_zero_copy_completions(bool wait);
+	void complete_zero_copy(uint32_t first_id, uint32_t last_id);
+	bool busy_poll_read(redis::buffer_view unused, size_t& received);
+	bool apply_busy_poll_option();
+#endif
 
 	bool read_range_check() const;
 	bool write_range_check() const;
@@ -54,16 +285,171 @@ private:
 	redis::buffer_view unused_read_buffer();
 	redis::buffer_view unused_write_buffer();
 
-	bool connect_with_time_out(const std::string& ip, uint16_t port, int32_t time_out);
+	// views of an unallocated buffer point at 'unallocated_', since a view of nullptr is invalid
+	char* read_base() const
+	{
+		return read_buffer_.empty() ? &unallocated_ : const_cast<char*>(read_buffer_.data());
+	}
+	char* write_base() const
+	{
+		return write_buffer_.empty() ? &unallocated_ : const_cast<char*>(write_buffer_.data());
+	}
+
+	bool connect_to(const boost::asio::ip::tcp::endpoint& endpoint, int32_t time_out);
+	bool start_connect(const boost::asio::ip::tcp::endpoint& endpoint);
+	bool finish_connect();
+	static void finish_connects(std::vector<asio_stream_adaptor*>& connecting, std::chrono::steady_clock::time_point deadline);
+	bool setup_socket(int32_t time_out);
 
 private:
-	std::vector<char> read_buffer_;
-	std::vector<char> write_buffer_;
+	static char unallocated_;
+
+	size_t initial_buffer_size_;
+	size_t shrink_threshold_;
+	redis::reply_size_histogram read_sizes_;
+	size_t received_since_drain_;
+	double read_size_fraction_; // zero if adaptive sizing is disabled
+	size_t read_size_min_samples_;
+	std::chrono::steady_clock::time_point last_activity_;
+	redis::pooled_buffer read_buffer_;
+	redis::pooled_buffer write_buffer_;
 	redis::buffer_view to_be_read_;
 	redis::buffer_view to_be_written_;
+#ifdef __linux__
+	std::vector<std::pair<size_t, redis::file_region>> pending_files_; // (offset in to_be_written_, region)
+
+	// write buffers referenced by incomplete zero-copy sends
+	struct pinned_buffer
+	{
+		redis::pooled_buffer buffer;
+		uint32_t first_id;
+		uint32_t pending;
+	};
+
+	size_t zero_copy_threshold_; // zero if disabled
+	uint32_t zero_copy_next_id_;
+	uint32_t write_buffer_first_id_;
+	bool write_buffer_in_flight_;
+	std::deque<pinned_buffer> pinned_buffers_;
+	std::vector<redis::pooled_buffer> spare_buffers_;
+
+	std::chrono::microseconds busy_poll_budget_;
+	bool busy_poll_yield_;
+	int so_busy_poll_;
+	bool kernel_busy_poll_;
+	busy_poll_stats busy_poll_stats_;
+
+	int32_t io_time_out_; // in seconds, bounds the waits of sendfile and zero-copy sends, zero waits forever
+#endif
+
+	memory_limits memory_limits_;
+	size_t base_memory_; // the blocks of the initial buffers, not charged to the budget
+	size_t charged_memory_;
 
 	boost::asio::ip::tcp::socket socket_;
 	boost::system::error_code err_code_;
 };
 
+#ifdef REDIS_ASIO_ASYNC_REQUEST
+template<typename Handler>
+void asio_stream_adaptor::async_request_op<Handler>::start(const redis::command& cmd)
+{
+	if (!self->is_open()) {
+		complete(redis::error::stream_not_initialized, true);
+		return;
+	}
+
+	auto ec = cmd.write_command(*self);
+	if (ec) {
+		complete(self->close() ? redis::error::stream_error : ec, true);
+		return;
+	}
+
+#ifdef __linux__
+	if (!self->pending_files_.empty()) {
+		// file regions are only sent by flush - drop the command, the connection is still usable
+		self->pending_files_.clear();
+		self->to_be_written_ = redis::buffer_view(self->write_base(), size_t(0));
+		complete(redis::error::invalid_command_format, true);
+		return;
+	}
+#endif
+
+	auto& socket = self->socket_;
+	auto data = self->to_be_written_;
+	boost::asio::async_write(socket, boost::asio::buffer(data.data(), data.size()), std::move(*this));
+}
+
+template<typename Handler>
+void asio_stream_adaptor::async_request_op<Handler>::operator()(const boost::system::error_code& ec, size_t transferred)
+{
+	if (ec || (reading && transferred == 0)) {
+		self->err_code_ = ec;
+		self->close();
+		complete(redis::error::stream_error, false);
+		return;
+	}
+
+	if (!reading) {
+		self->to_be_written_ = redis::buffer_view(self->write_base(), size_t(0));
+		reading = true;
+	} else {
+		self->to_be_read_ = redis::buffer_view(self->to_be_read_.begin(), self->to_be_read_.size() + transferred);
+		self->received_since_drain_ += transferred;
+	}
+	continue_reading();
+}
+
+template<typename Handler>
+void asio_stream_adaptor::async_request_op<Handler>::continue_reading()
+{
+	switch (scanner.scan(self->to_be_read_)) {
+	case redis::reply_scanner::complete: {
+		// the whole reply is buffered, so the synchronous parser does not touch the socket
+		auto ec = redis::parse(*self, *handler);
+		if (ec && ec != redis::error::error_reply && ec != redis::error::handler_error) {
+			self->close();
+		}
+		complete(ec, false);
+		return;
+	}
+
+	case redis::reply_scanner::ill_formed:
+		self->close();
+		complete(redis::error::ill_formed_reply, false);
+		return;
+
+	case redis::reply_scanner::incomplete:
+		break;
+	}
+
+	if (self->unused_read_buffer().size() <= self->read_buffer_.size() / 4 &&
+		!self->move_and_ensure_read_buffer(std::max<size_t>(self->read_buffer_.size() / 2, 1))) {
+		self->close();
+		complete(redis::error::stream_error, false);
+		return;
+	}
+
+	auto& socket = self->socket_;
+	auto unused = self->unused_read_buffer();
+	socket.async_read_some(boost::asio::buffer(unused.data(), unused.size()), std::move(*this));
+}
+
+template<typename Handler>
+void asio_stream_adaptor::async_request_op<Handler>::complete(std::error_code ec, bool immediately)
+{
+	// the completion handler runs on its associated executor, and never inside async_request itself
+	auto executor = boost::asio::get_associated_executor(completion, self->socket_.get_executor());
+	auto bound = [handler = std::move(completion), ec]() mutable {
+		handler(ec);
+	};
+
+	if (immediately) {
+		boost::asio::post(executor, std::move(bound));
+	} else {
+		boost::asio::dispatch(executor, std::move(bound));
+	}
+}
+#endif
+
 #endif // REDIS_ASIO_ADAPTOR_H
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "buffer_pool.h"
+
+#include <mutex>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace redis {
+
+namespace {
+
+std::mutex configuration_lock;
+bool pool_created = false;
+
+buffer_pool::options& configured_options()
+{
+    static buffer_pool::options opts;
+    return opts;
+}
+
+// whether the thread cache of the calling thread is there - a trivial thread_local stays valid until the thread ends,
+// so buffers freed after the cache was destroyed (by static or earlier constructed thread_local objects) can tell
+enum cache_state
+{
+    cache_unused,
+    cache_alive,
+    cache_destroyed,
+};
+
+thread_local cache_state my_cache_state = cache_unused;
+
+} // the end of anonymous namespace
+
+const size_t buffer_pool::min_block_size;
+const size_t buffer_pool::max_block_size;
+const size_t buffer_pool::class_count;
+
+// free blocks of the calling thread, given back to the shared free lists when the thread exits
+struct buffer_pool::thread_cache
+{
+    thread_cache() : owner(nullptr)
+    {
+        my_cache_state = cache_alive;
+    }
+
+    ~thread_cache()
+    {
+        my_cache_state = cache_destroyed;
+        if (owner != nullptr) {
+            for (size_t i = 0; i < class_count; i++) {
+                owner->deallocate_shared(i, blocks[i], 0);
+            }
+        }
+    }
+
+    buffer_pool* owner;
+    std::vector<char*> blocks[class_count];
+};
+
+bool buffer_pool::configure(const options& opts)
+{
+    std::lock_guard<std::mutex> guard(configuration_lock);
+    if (pool_created) {
+        return false;
+    }
+    configured_options() = opts;
+    return true;
+}
+
+buffer_pool& buffer_pool::instance()
+{
+    // never destroyed, so that the thread caches can give their blocks back whenever their threads exit
+    static buffer_pool* pool = [] {
+        std::lock_guard<std::mutex> guard(configuration_lock);
+        pool_created = true;
+        return new buffer_pool(configured_options());
+    }();
+    return *pool;
+}
+
+buffer_pool::buffer_pool(const options& opts)
+    : options_(opts), slab_bytes_(0), pooled_in_use_(0), direct_in_use_(0), cache_hits_(0), shared_hits_(0), slab_allocations_(0)
+{
+}
+
+char* buffer_pool::allocate(size_t& size)
+{
+    if (size > max_block_size) {
+        auto block = static_cast<char*>(::operator new(size));
+        direct_in_use_.fetch_add(size, std::memory_order_relaxed);
+        return block;
+    }
+
+    auto index = class_of(size);
+    size = class_size(index);
+
+    auto my = my_cache();
+    char* block = nullptr;
+    if (my == nullptr) {
+        // the thread is exiting - the blocks taken along go back at once
+        std::vector<char*> none;
+        block = allocate_shared(index, none);
+        deallocate_shared(index, none, 0);
+    } else if (!my->blocks[index].empty()) {
+        auto& cache = my->blocks[index];
+        block = cache.back();
+        cache.pop_back();
+        cache_hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        block = allocate_shared(index, my->blocks[index]);
+    }
+
+    pooled_in_use_.fetch_add(size, std::memory_order_relaxed);
+    return block;
+}
+
+void buffer_pool::deallocate(char* block, size_t size)
+{
+    if (size > max_block_size) {
+        ::operator delete(block);
+        direct_in_use_.fetch_sub(size, std::memory_order_relaxed);
+        return;
+    }
+
+    auto index = class_of(size);
+    pooled_in_use_.fetch_sub(class_size(index), std::memory_order_relaxed);
+
+    auto my = my_cache();
+    if (my == nullptr) {
+        std::vector<char*> single(1, block);
+        deallocate_shared(index, single, 0);
+        return;
+    }
+
+    auto& cache = my->blocks[index];
+    cache.push_back(block);
+    if (cache.size() > options_.thread_cache_blocks) {
+        deallocate_shared(index, cache, options_.thread_cache_blocks / 2);
+    }
+}
+
+buffer_pool::statistics buffer_pool::stats() const
+{
+    statistics result;
+    result.slab_bytes = slab_bytes_.load(std::memory_order_relaxed);
+    result.pooled_in_use = pooled_in_use_.load(std::memory_order_relaxed);
+    result.direct_in_use = direct_in_use_.load(std::memory_order_relaxed);
+    result.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+    result.shared_hits = shared_hits_.load(std::memory_order_relaxed);
+    result.slab_allocations = slab_allocations_.load(std::memory_order_relaxed);
+    return result;
+}
+
+size_t buffer_pool::block_size(size_t size)
+{
+    return size > max_block_size ? size : class_size(class_of(size));
+}
+
+size_t buffer_pool::class_of(size_t size)
+{
+    size_t index = 0;
+    for (size_t block = min_block_size; block < size; block <<= 1) {
+        index++;
+    }
+    assert(index < class_count);
+    return index;
+}
+
+size_t buffer_pool::class_size(size_t index)
+{
+    return min_block_size << index;
+}
+
+char* buffer_pool::allocate_shared(size_t index, std::vector<char*>& cache)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto& free = free_[index];
+    if (free.empty()) {
+        allocate_slab(index);
+    } else {
+        shared_hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // takes half a cache worth at once, so that the next allocations of the thread take no lock
+    auto block = free.back();
+    free.pop_back();
+    while (!free.empty() && cache.size() < options_.thread_cache_blocks / 2) {
+        cache.push_back(free.back());
+        free.pop_back();
+    }
+    return block;
+}
+
+void buffer_pool::deallocate_shared(size_t index, std::vector<char*>& cache, size_t keep)
+{
+    if (cache.size() <= keep) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    free_[index].insert(free_[index].end(), cache.begin() + keep, cache.end());
+    cache.resize(keep);
+}
+
+void buffer_pool::allocate_slab(size_t index)
+{
+    // slab sizes are powers of two, so a slab is split into whole blocks
+    auto block_size = class_size(index);
+    auto slab_size = std::max(options_.slab_size, block_size);
+    slab_size -= slab_size % block_size;
+
+    auto slab = map_memory(slab_size, options_.use_huge_pages);
+    if (slab == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    auto& free = free_[index];
+    for (size_t offset = slab_size; offset > 0; offset -= block_size) {
+        free.push_back(slab + offset - block_size);
+    }
+
+    slab_bytes_.fetch_add(slab_size, std::memory_order_relaxed);
+    slab_allocations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+char* buffer_pool::map_memory(size_t size, bool huge_pages)
+{
+#ifdef __linux__
+    void* memory = MAP_FAILED;
+    if (huge_pages) {
+        memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (memory == MAP_FAILED) {
+        memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        if (huge_pages) {
+            ::madvise(memory, size, MADV_HUGEPAGE); // no reserved hugepages - ask for transparent ones
+        }
+    }
+    return static_cast<char*>(memory);
+#else
+    return static_cast<char*>(::operator new(size, std::nothrow));
+#endif
+}
+
+buffer_pool::thread_cache* buffer_pool::my_cache()
+{
+    if (my_cache_state == cache_destroyed) {
+        return nullptr;
+    }
+
+    thread_local thread_cache cache;
+    cache.owner = this;
+    return &cache;
+}
+
+
+// pooled_buffer implementation
+void pooled_buffer::resize(size_t size)
+{
+    if (size <= capacity_) {
+        size_ = size;
+        return;
+    }
+
+    auto capacity = size;
+    auto block = buffer_pool::instance().allocate(capacity);
+    if (size_ > 0) {
+        std::memcpy(block, data_, size_);
+    }
+
+    release();
+    data_ = block;
+    size_ = size;
+    capacity_ = capacity;
+}
+
+void pooled_buffer::release()
+{
+    if (data_ != nullptr) {
+        buffer_pool::instance().deallocate(data_, capacity_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+    capacity_ = 0;
+}
+
+} // namespace "redis"
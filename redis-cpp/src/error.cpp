@@ -40,13 +40,19 @@ std::string error_category::message(int ev) const noexcept
         return "given reply handler object failed to handle reply";
     case error::subscriber_cmd_error:
         return "subscriber command should only be used in compatible session object";
+    case error::timed_out:
+        return "reply did not arrive before the deadline - the connection is kept and the late reply is skipped";
+    case error::no_connection:
+        return "no pooled connection was returned in time, or connecting failed - the request was not sent";
+    case error::no_pending_request:
+        return "no request is waiting for its reply on the session - receive_reply follows send_request";
     default:
         return "unknown error code - error code object may be corrupted";
     }
 }
 
 namespace {
-thread_local error_category error_category_instance;
+error_category error_category_instance;
 } // the end of anonmymous namespace
 
 const std::error_category& category()
@@ -0,0 +1,508 @@
+#include "fiber.h"
+
+#ifdef REDIS_HAS_FIBERS
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "redis_base.h"
+
+namespace redis {
+
+namespace {
+
+thread_local fiber_scheduler* current_scheduler = nullptr;
+
+} // the end of anonymous namespace
+
+// fiber_scheduler implementation
+fiber_scheduler::fiber_scheduler() : waiting_(0), epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)), running_(nullptr)
+{
+}
+
+fiber_scheduler::~fiber_scheduler()
+{
+    // fibers which never finished are dropped with their stacks, without unwinding them
+    if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+    }
+}
+
+void fiber_scheduler::spawn(entry_type entry, size_t stack_size)
+{
+    std::unique_ptr<fiber> f(new fiber());
+    f->stack.reset(new char[stack_size]);
+    f->entry = std::move(entry);
+    f->index = fibers_.size();
+    f->finished = false;
+    f->waiting_fd = -1;
+    f->timed_out = false;
+    f->has_timer = false;
+
+    ::getcontext(&f->context);
+    f->context.uc_stack.ss_sp = f->stack.get();
+    f->context.uc_stack.ss_size = stack_size;
+    f->context.uc_link = nullptr; // a finished fiber switches back by itself
+    ::makecontext(&f->context, &fiber_scheduler::start_fiber, 0);
+
+    ready_.push_back(f.get());
+    fibers_.push_back(std::move(f));
+}
+
+void fiber_scheduler::run()
+{
+    auto previous = current_scheduler;
+    current_scheduler = this;
+
+    while (!ready_.empty() || waiting_ > 0) {
+        // every ready fiber gets its turn before the parked ones are checked again
+        for (size_t count = ready_.size(); count > 0; count--) {
+            auto f = ready_.front();
+            ready_.pop_front();
+            resume(f);
+        }
+
+        if (waiting_ > 0) {
+            poll_events(ready_.empty() ? next_timeout() : 0);
+            expire_timers();
+        }
+    }
+
+    current_scheduler = previous;
+
+    if (error_) {
+        std::exception_ptr error;
+        std::swap(error, error_);
+        std::rethrow_exception(error);
+    }
+}
+
+fiber_scheduler* fiber_scheduler::current()
+{
+    return current_scheduler != nullptr && current_scheduler->running_ != nullptr ? current_scheduler : nullptr;
+}
+
+void fiber_scheduler::yield()
+{
+    assert(running_ != nullptr);
+    ready_.push_back(running_);
+    switch_to_scheduler();
+}
+
+bool fiber_scheduler::wait_fd(int fd, uint32_t events)
+{
+    return wait_fd(fd, events, std::chrono::steady_clock::time_point::max());
+}
+
+bool fiber_scheduler::wait_fd(int fd, uint32_t events, std::chrono::steady_clock::time_point deadline)
+{
+    if (running_ == nullptr || epoll_fd_ < 0) {
+        return false;
+    }
+
+    // one-shot, so that a parked fiber is made ready only once per wait
+    epoll_event ev = {};
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = running_;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        if (errno != ENOENT || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            return false;
+        }
+    }
+
+    auto f = running_;
+    f->waiting_fd = fd;
+    f->timed_out = false;
+    f->has_timer = deadline != std::chrono::steady_clock::time_point::max();
+    if (f->has_timer) {
+        f->timer = timers_.emplace(deadline, f);
+    }
+
+    waiting_++;
+    switch_to_scheduler();
+    waiting_--;
+    return !f->timed_out;
+}
+
+void fiber_scheduler::start_fiber()
+{
+    auto scheduler = current_scheduler;
+    auto f = scheduler->running_;
+
+    // an exception can not unwind past the fiber stack
+    try {
+        f->entry();
+    } catch (...) {
+        if (!scheduler->error_) {
+            scheduler->error_ = std::current_exception();
+        }
+    }
+
+    f->entry = nullptr;
+    f->finished = true;
+    scheduler->switch_to_scheduler(); // never returns
+}
+
+void fiber_scheduler::switch_to_scheduler()
+{
+    ::swapcontext(&running_->context, &scheduler_context_);
+}
+
+void fiber_scheduler::resume(fiber* f)
+{
+    running_ = f;
+    ::swapcontext(&scheduler_context_, &f->context);
+    running_ = nullptr;
+
+    if (f->finished) {
+        auto index = f->index;
+        std::swap(fibers_[index], fibers_.back());
+        fibers_[index]->index = index;
+        fibers_.pop_back();
+    }
+}
+
+void fiber_scheduler::poll_events(int timeout)
+{
+    epoll_event events[64];
+
+    auto result = ::epoll_wait(epoll_fd_, events, 64, timeout);
+    for (int i = 0; i < result; i++) {
+        auto f = static_cast<fiber*>(events[i].data.ptr);
+        f->waiting_fd = -1;
+        if (f->has_timer) {
+            timers_.erase(f->timer);
+            f->has_timer = false;
+        }
+        ready_.push_back(f);
+    }
+}
+
+int fiber_scheduler::next_timeout() const
+{
+    if (timers_.empty()) {
+        return -1;
+    }
+
+    // rounded up, so that the timer has expired when epoll_wait returns
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(timers_.begin()->first - std::chrono::steady_clock::now()).count();
+    return remaining > 0 ? static_cast<int>(std::min<int64_t>((remaining + 999) / 1000, INT_MAX)) : 0;
+}
+
+void fiber_scheduler::expire_timers()
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+        auto f = timers_.begin()->second;
+        timers_.erase(timers_.begin());
+
+        // disarmed, so that a late event does not wake the fiber in its next wait
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, f->waiting_fd, nullptr);
+        f->waiting_fd = -1;
+        f->has_timer = false;
+        f->timed_out = true;
+        ready_.push_back(f);
+    }
+}
+
+
+// fiber_stream implementation
+fiber_stream::fiber_stream(size_t initial_buffer_size)
+    : fd_(-1), read_buffer_(initial_buffer_size), write_buffer_(initial_buffer_size), written_(0)
+{
+    reset();
+}
+
+fiber_stream::~fiber_stream()
+{
+    close();
+}
+
+bool fiber_stream::close()
+{
+    if (fd_ >= 0) {
+        ::close(fd_); // also removes it from the epoll set
+        fd_ = -1;
+    }
+    reset();
+    return true;
+}
+
+bool fiber_stream::is_open() const
+{
+    return fd_ >= 0;
+}
+
+// redis::stream input interface implementation
+size_t fiber_stream::available() const
+{
+    int pending = 0;
+    if (fd_ >= 0 && ::ioctl(fd_, FIONREAD, &pending) < 0) {
+        pending = 0;
+    }
+    return to_be_read_.size() + static_cast<size_t>(pending);
+}
+
+const_buffer_view fiber_stream::peek(size_t n)
+{
+    auto result = ensure_available_buffer(std::min(n, available()));
+    return result.first;
+}
+
+const_buffer_view fiber_stream::read(size_t n)
+{
+    auto result = ensure_available_buffer(n);
+    if (result.first.valid()) {
+        to_be_read_ = result.second;
+    }
+    return result.first;
+}
+
+size_t fiber_stream::skip(size_t n)
+{
+    return read(n).size();
+}
+
+bool fiber_stream::wait_readable(std::chrono::milliseconds timeout)
+{
+    if (fd_ < 0) {
+        return true;
+    }
+
+    pollfd p = {};
+    p.fd = fd_;
+    p.events = POLLIN;
+
+    auto readable = [&p](int wait) {
+        for (;;) {
+            auto result = ::poll(&p, 1, wait);
+            if (result >= 0 || errno != EINTR) {
+                return result != 0;
+            }
+        }
+    };
+
+    auto scheduler = fiber_scheduler::current();
+    if (scheduler == nullptr) {
+        return readable(static_cast<int>(timeout.count()));
+    }
+
+    // the fiber is parked until the socket is readable or the deadline passed, and checks the socket once more
+    // when it could not be watched
+    if (readable(0) || scheduler->wait_fd(fd_, EPOLLIN, std::chrono::steady_clock::now() + timeout)) {
+        return true;
+    }
+    return readable(0);
+}
+
+std::pair<buffer_view, buffer_view> fiber_stream::ensure_available_buffer(size_t at_least)
+{
+    if (to_be_read_.size() < at_least) {
+        if (!read_from_socket(at_least - to_be_read_.size())) {
+            return buffer_view().split(0); // returns invalid buffer
+        }
+    }
+
+    assert(to_be_read_.size() >= at_least);
+    return to_be_read_.split(at_least);
+}
+
+bool fiber_stream::read_from_socket(size_t at_least)
+{
+    if (fd_ < 0) {
+        return false;
+    }
+
+    if (to_be_read_.size() == 0 || unused_read_buffer().size() < at_least) {
+        move_and_ensure_read_buffer(at_least);
+    }
+
+    size_t read_byte = 0;
+
+    while (read_byte < at_least) {
+        auto target = unused_read_buffer();
+        auto result = ::recv(fd_, target.begin(), target.size(), 0);
+        if (result == 0) {
+            return false; // the peer closed the stream
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait(EPOLLIN)) {
+                continue;
+            }
+            return false;
+        }
+
+        read_byte += static_cast<size_t>(result);
+        to_be_read_ = buffer_view(to_be_read_.begin(), to_be_read_.size() + static_cast<size_t>(result));
+    }
+    return true;
+}
+
+buffer_view fiber_stream::unused_read_buffer()
+{
+    return buffer_view(to_be_read_.end(), read_buffer_.data() + read_buffer_.size());
+}
+
+void fiber_stream::move_and_ensure_read_buffer(size_t at_least)
+{
+    size_t available_size = to_be_read_.size();
+
+    if (read_buffer_.size() - available_size < at_least) {
+        pooled_buffer swapped(std::max(available_size + at_least, read_buffer_.size() * 2));
+        std::copy(to_be_read_.begin(), to_be_read_.end(), swapped.begin());
+        read_buffer_.swap(swapped);
+    } else {
+        std::copy(to_be_read_.begin(), to_be_read_.end(), read_buffer_.begin());
+    }
+
+    to_be_read_ = buffer_view(read_buffer_.data(), available_size);
+}
+
+// redis::stream output interface implementation
+bool fiber_stream::flush()
+{
+    if (fd_ < 0) {
+        return false;
+    }
+
+    size_t sent = 0;
+
+    while (sent < written_) {
+        auto result = ::send(fd_, write_buffer_.data() + sent, written_ - sent, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait(EPOLLOUT)) {
+                continue;
+            }
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+
+    written_ = 0;
+    return true;
+}
+
+bool fiber_stream::write(const_buffer_view input)
+{
+    if (written_ + input.size() > write_buffer_.size()) {
+        write_buffer_.resize(std::max(written_ + input.size(), write_buffer_.size() * 2));
+    }
+
+    std::copy(input.begin(), input.end(), write_buffer_.begin() + written_);
+    written_ += input.size();
+    return true;
+}
+
+size_t fiber_stream::pending_output() const
+{
+    return written_;
+}
+
+// fiber_stream member functions
+void fiber_stream::reset()
+{
+    to_be_read_ = buffer_view(read_buffer_.data(), read_buffer_.data());
+    written_ = 0;
+}
+
+bool fiber_stream::wait(uint32_t events)
+{
+    auto scheduler = fiber_scheduler::current();
+    if (scheduler != nullptr) {
+        return scheduler->wait_fd(fd_, events);
+    }
+
+    // not on a fiber - block the thread
+    pollfd p = {};
+    p.fd = fd_;
+    p.events = static_cast<short>((events & EPOLLIN ? POLLIN : 0) | (events & EPOLLOUT ? POLLOUT : 0));
+    for (;;) {
+        auto result = ::poll(&p, 1, -1);
+        if (result >= 0 || errno != EINTR) {
+            return result > 0;
+        }
+    }
+}
+
+bool fiber_stream::connect(const std::string& host, uint16_t port)
+{
+    if (is_open()) {
+        return false;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+        return false;
+    }
+
+    for (auto address = addresses; address != nullptr; address = address->ai_next) {
+        fd_ = ::socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd_ < 0) {
+            continue;
+        }
+
+        auto result = ::connect(fd_, address->ai_addr, address->ai_addrlen);
+        if (result < 0 && errno == EINPROGRESS && wait(EPOLLOUT)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            result = (::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) ? 0 : -1;
+        }
+
+        if (result == 0) {
+            int on = 1;
+            ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            break;
+        }
+        close();
+    }
+
+    ::freeaddrinfo(addresses);
+    reset();
+    return is_open();
+}
+
+bool fiber_stream::attach(int fd)
+{
+    if (is_open() || fd < 0) {
+        return false;
+    }
+
+    auto flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    fd_ = fd;
+    reset();
+    return true;
+}
+
+} // namespace "redis"
+
+#endif // REDIS_HAS_FIBERS
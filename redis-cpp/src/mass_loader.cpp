@@ -0,0 +1,163 @@
+#include "mass_loader.h"
+
+#include <deque>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "redis_base.h"
+#include "parser.h"
+#include "finally.h"
+#include "error.h"
+
+namespace redis {
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+// skip-parse handler - replies are only walked through, and error replies are counted and sampled
+class counting_handler final : public reply_handler
+{
+public:
+    counting_handler(load_stats& stats, size_t max_samples) : stats_(stats), max_samples_(max_samples) {}
+
+    virtual bool on_status(const_buffer_view data) override { return true; }
+    virtual bool on_integer(int64_t value) override { return true; }
+    virtual bool on_null() override { return true; }
+    virtual bool on_bulk(const_buffer_view data) override { return true; }
+    virtual bool on_multi_bulk_begin(size_t count) override { return true; }
+    virtual bool on_enter_reply(size_t recursion_depth) override { return true; }
+    virtual bool on_leave_reply(size_t recursion_depth) override { return true; }
+
+    virtual bool on_error(const_buffer_view data) override
+    {
+        stats_.errors++;
+        if (stats_.error_samples.size() < max_samples_) {
+            stats_.error_samples.emplace_back(data.begin(), data.end());
+        }
+        return true;
+    }
+
+private:
+    load_stats& stats_;
+    size_t max_samples_;
+};
+
+// counts the bytes the source writes - pending_output of the connection can not tell them when a write flushes on its own
+class counting_stream final : public stream
+{
+public:
+    counting_stream(stream& connection) : connection_(connection), written_(0) {}
+
+    virtual bool close() override { return connection_.close(); }
+    virtual bool is_open() const override { return connection_.is_open(); }
+
+    virtual size_t available() const override { return connection_.available(); }
+    virtual const_buffer_view peek(size_t n) override { return connection_.peek(n); }
+    virtual const_buffer_view read(size_t n) override { return connection_.read(n); }
+    virtual size_t skip(size_t n) override { return connection_.skip(n); }
+    virtual bool read_into(buffer_view output) override { return connection_.read_into(output); }
+    virtual bool wait_readable(std::chrono::milliseconds timeout) override { return connection_.wait_readable(timeout); }
+
+    virtual bool flush() override { return connection_.flush(); }
+    virtual size_t pending_output() const override { return connection_.pending_output(); }
+
+    virtual bool write(const_buffer_view input) override
+    {
+        written_ += input.size();
+        return connection_.write(input);
+    }
+
+    virtual bool write_file(const file_region& region) override
+    {
+        written_ += region.length;
+        return connection_.write_file(region);
+    }
+
+    size_t written() const
+    {
+        return written_;
+    }
+
+private:
+    stream& connection_;
+    size_t written_;
+};
+
+struct in_flight_command
+{
+    size_t bytes;
+    clock_type::time_point written;
+};
+
+} // the end of anonymous namespace
+
+std::error_code mass_loader::load(stream& connection, const source_type& source, load_stats& stats) const
+{
+    if (!connection.is_open()) {
+        return redis::error::stream_not_initialized;
+    }
+
+    auto started = clock_type::now();
+    auto on_return = finally([&] {
+        stats.elapsed = clock_type::now() - started;
+    });
+
+    counting_handler handler(stats, max_error_samples);
+    counting_stream output(connection);
+    std::deque<in_flight_command> window;
+    size_t window_bytes = 0;
+    size_t flushed = 0;
+    bool exhausted = false;
+
+    auto window_full = [&] {
+        return !window.empty() && (window.size() >= max_in_flight_commands || window_bytes >= max_in_flight_bytes);
+    };
+
+    while (!exhausted || !window.empty()) {
+        // write commands until the window is full or enough of them are buffered for one flush
+        bool written = false;
+        while (!exhausted && !window_full() && (!written || output.written() - flushed < flush_size)) {
+            auto before = output.written();
+            if (!source(output)) {
+                exhausted = true;
+                break;
+            }
+
+            in_flight_command sent = { output.written() - before, clock_type::now() };
+            window.push_back(sent);
+            window_bytes += sent.bytes;
+            written = true;
+
+            stats.commands++;
+            stats.bytes += sent.bytes;
+            stats.max_in_flight = std::max(stats.max_in_flight, window.size());
+        }
+
+        if (written && !connection.flush()) {
+            return redis::error::stream_error;
+        }
+        flushed = output.written();
+
+        // take the replies which already arrived, and wait for more only when nothing else can be written
+        bool must_read = exhausted || window_full();
+        while (!window.empty() && (must_read || connection.available() > 0)) {
+            auto ec = parse_typed(connection, handler);
+            if (ec && ec != redis::error::error_reply) {
+                return ec;
+            }
+
+            auto& answered = window.front();
+            stats.max_lag = std::max(stats.max_lag, clock_type::now() - answered.written);
+            stats.replies++;
+            window_bytes -= answered.bytes;
+            window.pop_front();
+
+            must_read = exhausted;
+        }
+    }
+    return std::error_code();
+}
+
+} // namespace "redis"
@@ -0,0 +1,72 @@
+#include "memory_budget.h"
+
+#include <mutex>
+#include <chrono>
+#include <cassert>
+
+namespace redis {
+
+memory_budget::memory_budget(size_t limit) : limit_(limit), used_(0), waits_(0), rejections_(0)
+{
+}
+
+bool memory_budget::try_acquire(size_t n)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    if (n > limit_ - used_) {
+        rejections_++;
+        return false;
+    }
+    used_ += n;
+    return true;
+}
+
+bool memory_budget::acquire(size_t n, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    if (n > limit_) {
+        rejections_++;
+        return false;
+    }
+
+    if (n > limit_ - used_) {
+        waits_++;
+        if (!released_.wait_for(guard, timeout, [&] { return n <= limit_ - used_; })) {
+            rejections_++;
+            return false;
+        }
+    }
+    used_ += n;
+    return true;
+}
+
+void memory_budget::release(size_t n)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        assert(n <= used_);
+        used_ -= n;
+    }
+    // waiters need different sizes, so every one of them checks again
+    released_.notify_all();
+}
+
+size_t memory_budget::used() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return used_;
+}
+
+uint64_t memory_budget::waits() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return waits_;
+}
+
+uint64_t memory_budget::rejections() const
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return rejections_;
+}
+
+} // namespace "redis"
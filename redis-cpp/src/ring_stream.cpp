@@ -0,0 +1,382 @@
+#include "ring_stream.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "redis_base.h"
+#include "spsc_ring.h"
+
+namespace redis {
+
+namespace {
+
+// the segment starts with its ring capacity, so that open_shared does not need to know it
+const size_t segment_header_size = 64;
+
+size_t round_up_capacity(size_t capacity)
+{
+    size_t result = 64;
+    while (result < capacity) {
+        result *= 2;
+    }
+    return result;
+}
+
+size_t ring_offset(size_t capacity, int index)
+{
+    return segment_header_size + spsc_ring::required_size(capacity) * index;
+}
+
+// spins for a while first, and gives up the time slice when the peer is not fast enough
+void wait_for_peer(size_t& spins)
+{
+    if (++spins < 64) {
+        return;
+    }
+    std::this_thread::yield();
+}
+
+} // the end of anonymous namespace
+
+// ring_channel implementation
+ring_channel::ring_channel() : memory_(nullptr), memory_size_(0), capacity_(0), shared_(false), owner_(false)
+{
+}
+
+ring_channel::~ring_channel()
+{
+#ifndef _WIN32
+    if (shared_ && memory_ != nullptr) {
+        ::munmap(memory_, memory_size_);
+        if (owner_) {
+            ::shm_unlink(name_.c_str());
+        }
+    }
+#endif
+}
+
+std::unique_ptr<ring_channel> ring_channel::create(size_t capacity)
+{
+    std::unique_ptr<ring_channel> channel(new ring_channel());
+    channel->capacity_ = round_up_capacity(capacity);
+    channel->memory_size_ = ring_offset(channel->capacity_, 2);
+    channel->local_memory_.resize(channel->memory_size_ + 64);
+
+    // align the rings to the cache line
+    auto address = reinterpret_cast<uintptr_t>(channel->local_memory_.data());
+    channel->memory_ = channel->local_memory_.data() + ((64 - address % 64) % 64);
+
+    for (int i = 0; i < 2; i++) {
+        spsc_ring ring;
+        ring.attach(static_cast<char*>(channel->memory_) + ring_offset(channel->capacity_, i), channel->capacity_, true);
+    }
+    return channel;
+}
+
+std::unique_ptr<ring_channel> ring_channel::create_shared(const std::string& name, size_t capacity)
+{
+#ifndef _WIN32
+    std::unique_ptr<ring_channel> channel(new ring_channel());
+    channel->capacity_ = round_up_capacity(capacity);
+    channel->memory_size_ = ring_offset(channel->capacity_, 2);
+
+    auto fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    if (::ftruncate(fd, static_cast<off_t>(channel->memory_size_)) < 0) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    auto memory = ::mmap(nullptr, channel->memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    channel->memory_ = memory;
+    channel->shared_ = true;
+    channel->owner_ = true;
+    channel->name_ = name;
+
+    for (int i = 0; i < 2; i++) {
+        spsc_ring ring;
+        ring.attach(static_cast<char*>(memory) + ring_offset(channel->capacity_, i), channel->capacity_, true);
+    }
+    // publish the capacity last - open_shared treats zero as a segment being initialized
+    std::atomic_thread_fence(std::memory_order_release);
+    *static_cast<uint64_t*>(memory) = channel->capacity_;
+    return channel;
+#else
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<ring_channel> ring_channel::open_shared(const std::string& name)
+{
+#ifndef _WIN32
+    auto fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < segment_header_size) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<ring_channel> channel(new ring_channel());
+    channel->memory_size_ = static_cast<size_t>(st.st_size);
+
+    auto memory = ::mmap(nullptr, channel->memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+
+    channel->memory_ = memory;
+    channel->shared_ = true;
+    channel->name_ = name;
+    channel->capacity_ = static_cast<size_t>(*static_cast<volatile uint64_t*>(memory));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (channel->capacity_ == 0 || ring_offset(channel->capacity_, 2) > channel->memory_size_) {
+        return nullptr; // not initialized yet, or not a ring channel
+    }
+    return channel;
+#else
+    return nullptr;
+#endif
+}
+
+void ring_channel::attach(side s, spsc_ring& input, spsc_ring& output)
+{
+    // ring 0 carries requests to the server side, ring 1 carries replies to the client side
+    auto base = static_cast<char*>(memory_);
+    auto request_ring = base + ring_offset(capacity_, 0);
+    auto reply_ring = base + ring_offset(capacity_, 1);
+
+    input.attach(s == client_side ? reply_ring : request_ring, capacity_, false);
+    output.attach(s == client_side ? request_ring : reply_ring, capacity_, false);
+}
+
+
+// ring_stream implementation
+ring_stream::ring_stream(size_t initial_buffer_size)
+    : read_buffer_(initial_buffer_size), write_buffer_(initial_buffer_size), written_(0), flush_timeout_(5000)
+{
+    reset();
+}
+
+ring_stream::~ring_stream()
+{
+    close();
+}
+
+bool ring_stream::close()
+{
+    if (output_.is_attached()) {
+        output_.close(); // the peer reads the end of stream after the remaining data
+    }
+    if (input_.is_attached()) {
+        input_.close_reader(); // a flush of the peer fails instead of waiting for room
+    }
+    input_.detach();
+    output_.detach();
+    reset();
+    return true;
+}
+
+bool ring_stream::is_open() const
+{
+    return input_.is_attached();
+}
+
+// redis::stream input interface implementation
+size_t ring_stream::available() const
+{
+    return to_be_read_.size() + (input_.is_attached() ? input_.readable() : 0);
+}
+
+const_buffer_view ring_stream::peek(size_t n)
+{
+    auto result = ensure_available_buffer(std::min(n, available()));
+    return result.first;
+}
+
+const_buffer_view ring_stream::read(size_t n)
+{
+    auto result = ensure_available_buffer(n);
+    if (result.first.valid()) {
+        to_be_read_ = result.second;
+    }
+    return result.first;
+}
+
+size_t ring_stream::skip(size_t n)
+{
+    return read(n).size();
+}
+
+bool ring_stream::wait_readable(std::chrono::milliseconds timeout)
+{
+    if (!input_.is_attached()) {
+        return true;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    size_t spins = 0;
+
+    while (input_.readable() == 0 && !input_.is_closed()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        wait_for_peer(spins);
+    }
+    return true;
+}
+
+std::pair<buffer_view, buffer_view> ring_stream::ensure_available_buffer(size_t at_least)
+{
+    if (to_be_read_.size() < at_least) {
+        if (!read_from_ring(at_least - to_be_read_.size())) {
+            return buffer_view().split(0); // returns invalid buffer
+        }
+    }
+
+    assert(to_be_read_.size() >= at_least);
+    return to_be_read_.split(at_least);
+}
+
+bool ring_stream::read_from_ring(size_t at_least)
+{
+    if (!input_.is_attached()) {
+        return false;
+    }
+
+    if (to_be_read_.size() == 0 || unused_read_buffer().size() < at_least) {
+        move_and_ensure_read_buffer(at_least);
+    }
+
+    size_t read_byte = 0;
+    size_t spins = 0;
+
+    while (read_byte < at_least) {
+        auto result = input_.read_some(unused_read_buffer());
+        if (result == 0) {
+            if (input_.is_closed() && input_.readable() == 0) {
+                return false; // the peer closed the stream
+            }
+            wait_for_peer(spins);
+            continue;
+        }
+
+        read_byte += result;
+        to_be_read_ = buffer_view(to_be_read_.begin(), to_be_read_.size() + result);
+    }
+    return true;
+}
+
+buffer_view ring_stream::unused_read_buffer()
+{
+    return buffer_view(to_be_read_.end(), read_buffer_.data() + read_buffer_.size());
+}
+
+void ring_stream::move_and_ensure_read_buffer(size_t at_least)
+{
+    size_t available_size = to_be_read_.size();
+
+    if (read_buffer_.size() - available_size < at_least) {
+        pooled_buffer swapped(std::max(available_size + at_least, read_buffer_.size() * 2));
+        std::copy(to_be_read_.begin(), to_be_read_.end(), swapped.begin());
+        read_buffer_.swap(swapped);
+    } else {
+        std::copy(to_be_read_.begin(), to_be_read_.end(), read_buffer_.begin());
+    }
+
+    to_be_read_ = buffer_view(read_buffer_.data(), available_size);
+}
+
+// redis::stream output interface implementation
+bool ring_stream::flush()
+{
+    if (!output_.is_attached()) {
+        return false;
+    }
+
+    size_t sent = 0;
+    size_t spins = 0;
+    auto deadline = std::chrono::steady_clock::now() + flush_timeout_;
+
+    while (sent < written_) {
+        auto result = output_.write_some(const_buffer_view(write_buffer_.data() + sent, written_ - sent));
+        if (result == 0) {
+            if (output_.is_reader_closed()) {
+                return false; // the peer closed the stream
+            }
+            if (flush_timeout_.count() > 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false; // the peer stopped reading
+            }
+            wait_for_peer(spins);
+            continue;
+        }
+        sent += result;
+        deadline = std::chrono::steady_clock::now() + flush_timeout_;
+    }
+
+    written_ = 0;
+    return true;
+}
+
+bool ring_stream::write(const_buffer_view input)
+{
+    if (written_ + input.size() > write_buffer_.size()) {
+        write_buffer_.resize(std::max(written_ + input.size(), write_buffer_.size() * 2));
+    }
+
+    std::copy(input.begin(), input.end(), write_buffer_.begin() + written_);
+    written_ += input.size();
+    return true;
+}
+
+size_t ring_stream::pending_output() const
+{
+    return written_;
+}
+
+// ring_stream member functions
+void ring_stream::reset()
+{
+    to_be_read_ = buffer_view(read_buffer_.data(), read_buffer_.data());
+    written_ = 0;
+}
+
+bool ring_stream::connect(ring_channel& channel, ring_channel::side s)
+{
+    if (is_open()) {
+        return false;
+    }
+
+    channel.attach(s, input_, output_);
+    reset();
+    return true;
+}
+
+} // namespace "redis"
@@ -0,0 +1,43 @@
+#include "sharded_client.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace redis {
+
+bool pin_current_thread(size_t cpu)
+{
+#ifdef _WIN32
+    if (cpu >= sizeof(DWORD_PTR) * 8) {
+        return false; // processor groups are not handled
+    }
+    return ::SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+size_t shard_for_key(const_buffer_view key, size_t shard_count)
+{
+    // FNV-1a, stable across processes so that every client maps a key to the same shard
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto i = key.begin(), e = key.end(); i != e; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(*i)) * 1099511628211ULL;
+    }
+    return shard_count > 0 ? static_cast<size_t>(hash % shard_count) : 0;
+}
+
+} // namespace "redis"
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "redis_base.h"
+#include "reply_scanner.h"
+
+namespace redis {
+
+namespace {
+
+int64_t read_file(int fd, char* buffer, size_t size, int64_t offset)
+{
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _read(fd, buffer, static_cast<unsigned int>(size));
+#else
+    return ::pread(fd, buffer, size, static_cast<off_t>(offset));
+#endif
+}
+
+// accepts any reply and keeps nothing of it
+struct discarding_handler : public reply_handler
+{
+    virtual bool on_status(const_buffer_view data) override { return true; }
+    virtual bool on_error(const_buffer_view data) override { return true; }
+    virtual bool on_integer(int64_t value) override { return true; }
+    virtual bool on_null() override { return true; }
+    virtual bool on_bulk(const_buffer_view data) override { return true; }
+    virtual bool on_multi_bulk_begin(size_t count) override { return true; }
+    virtual bool on_enter_reply(size_t recursion_depth) override { return true; }
+    virtual bool on_leave_reply(size_t recursion_depth) override { return true; }
+};
+
+} // the end of anonymous namespace
+
+// default implementation of file output - just copy the file content into the stream
+bool stream::write_file(const file_region& region)
+{
+    char buffer[16384];
+    auto offset = region.offset;
+    auto remaining = region.length;
+
+    while (remaining > 0) {
+        auto result = read_file(region.fd, buffer, std::min(remaining, sizeof(buffer)), offset);
+        if (result <= 0) { // error or unexpected end of file
+            return false;
+        }
+        if (!write(const_buffer_view(buffer, static_cast<size_t>(result)))) {
+            return false;
+        }
+        offset += result;
+        remaining -= static_cast<size_t>(result);
+    }
+    return true;
+}
+
+std::error_code wait_reply(stream& input, std::chrono::steady_clock::time_point deadline, size_t& reply_size)
+{
+    reply_scanner scanner;
+
+    for (;;) {
+        // takes in whatever arrived so far without blocking, and leaves it in the stream
+        auto buffered = input.available();
+        auto view = input.peek(buffered);
+        if (buffered > 0 && (!view.valid() || view.size() < buffered)) {
+            return error::stream_error;
+        }
+
+        switch (scanner.scan(view)) {
+        case reply_scanner::complete:
+            reply_size = scanner.reply_size();
+            return std::error_code();
+        case reply_scanner::ill_formed:
+            return error::ill_formed_reply;
+        case reply_scanner::incomplete:
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return error::timed_out;
+        }
+
+        // rounded up, so that the last wait does not end just before the deadline
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1));
+        if (!input.wait_readable(timeout)) {
+            return error::timed_out;
+        }
+        if (input.available() == buffered) {
+            return error::stream_error; // woken up by the end of the stream
+        }
+    }
+}
+
+std::error_code skip_reply(stream& input)
+{
+    discarding_handler handler;
+    return parse(input, handler);
+}
+
+} // namespace "redis"
@@ -0,0 +1,234 @@
+#include "work_stealing_executor.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "redis_base.h"
+#include "reply_scanner.h"
+#include "error.h"
+
+namespace redis {
+
+namespace {
+
+// the worker running on the current thread, so that tasks submitted by a worker stay on its own queue
+thread_local const void* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+// read-only stream over a framed reply
+class framed_stream final : public stream
+{
+public:
+    explicit framed_stream(const std::vector<char>& data) : data_(data), offset_(0) {}
+
+    virtual bool close() override { return true; }
+    virtual bool is_open() const override { return true; }
+
+    virtual size_t available() const override
+    {
+        return data_.size() - offset_;
+    }
+
+    virtual const_buffer_view peek(size_t n) override
+    {
+        return const_buffer_view(data_.data() + offset_, std::min(n, available()));
+    }
+
+    virtual const_buffer_view read(size_t n) override
+    {
+        if (n > available()) {
+            return const_buffer_view();
+        }
+        auto result = const_buffer_view(data_.data() + offset_, n);
+        offset_ += n;
+        return result;
+    }
+
+    virtual size_t skip(size_t n) override
+    {
+        auto size = std::min(n, available());
+        offset_ += size;
+        return size;
+    }
+
+    virtual bool flush() override { return false; }
+    virtual bool write(const_buffer_view input) override { return false; }
+
+private:
+    const std::vector<char>& data_;
+    size_t offset_;
+};
+
+} // the end of anonymous namespace
+
+// work_stealing_executor implementation
+work_stealing_executor::work_stealing_executor(size_t thread_count)
+    : next_worker_(0), queued_(0), sleeping_(0), steals_(0), stopping_(false)
+{
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_.emplace_back(new worker());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_[i]->thread = std::thread([this, i] { run(i); });
+    }
+}
+
+work_stealing_executor::~work_stealing_executor()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock_);
+        stopping_.store(true);
+    }
+    wake_up_.notify_all();
+
+    for (auto i = workers_.begin(), e = workers_.end(); i != e; ++i) {
+        (*i)->thread.join();
+    }
+}
+
+void work_stealing_executor::submit(task_type task)
+{
+    size_t index = current_executor == this ? current_worker : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+        std::lock_guard<std::mutex> guard(workers_[index]->lock);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+
+    // the workers only take the sleep lock when some of them sleep
+    queued_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+        std::lock_guard<std::mutex> guard(sleep_lock_);
+        wake_up_.notify_one();
+    }
+}
+
+bool work_stealing_executor::take(size_t index, task_type& task)
+{
+    {
+        auto& own = *workers_[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers_.size(); i++) {
+        auto& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1);
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_executor::run(size_t index)
+{
+    current_executor = this;
+    current_worker = index;
+
+    task_type task;
+    for (;;) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock_);
+        sleeping_.fetch_add(1);
+        while (queued_.load() == 0 && !stopping_.load()) {
+            wake_up_.wait(guard);
+        }
+        sleeping_.fetch_sub(1);
+
+        if (queued_.load() == 0 && stopping_.load()) {
+            break;
+        }
+    }
+
+    current_executor = nullptr;
+}
+
+
+std::error_code dispatch_reply(stream& input, work_stealing_executor& executor, std::shared_ptr<reply_handler> handler,
+    std::function<void(std::error_code)> done)
+{
+    // the reply is only framed here - its bytes are copied once into the task buffer, and the worker decodes them
+    auto framed = std::make_shared<std::vector<char>>();
+    reply_scanner scanner;
+
+    for (;;) {
+        auto offset = framed->size();
+        auto buffered = input.available();
+        reply_scanner::result state;
+
+        if (buffered > 0) {
+            auto view = input.peek(buffered);
+            if (!view.valid() || view.size() < buffered) {
+                return error::stream_error;
+            }
+
+            // the first piece is scanned in place, so that replies buffered behind this one are not copied
+            if (offset == 0) {
+                state = scanner.scan(view);
+            } else {
+                framed->insert(framed->end(), view.begin(), view.end());
+                state = scanner.scan(const_buffer_view(framed->data(), framed->size()));
+            }
+
+            // buffered bytes beyond the reply are left in the stream for the next one
+            auto used = state == reply_scanner::complete ? scanner.reply_size() - offset : buffered;
+            if (offset == 0) {
+                framed->assign(view.begin(), view.begin() + used);
+            } else {
+                framed->resize(offset + used);
+            }
+            input.skip(used);
+        } else {
+            if (scanner.bulk_remaining() > 0) {
+                // bulk data which is not buffered yet goes from the stream straight into the task buffer
+                auto size = scanner.bulk_remaining();
+                framed->resize(offset + size);
+                if (!input.read_into(buffer_view(framed->data() + offset, size))) {
+                    return error::stream_error;
+                }
+            } else {
+                auto view = input.read(1); // waits for the rest of a line
+                if (!view.valid() || view.size() != 1) {
+                    return error::stream_error;
+                }
+                framed->push_back(*view.begin());
+            }
+            state = scanner.scan(const_buffer_view(framed->data(), framed->size()));
+        }
+
+        if (state == reply_scanner::ill_formed) {
+            return error::ill_formed_reply;
+        }
+        if (state == reply_scanner::complete) {
+            break;
+        }
+    }
+
+    executor.submit([framed, handler, done] {
+        framed_stream in(*framed);
+        auto result = parse(in, *handler);
+        if (done) {
+            done(result);
+        }
+    });
+    return std::error_code();
+}
+
+} // namespace "redis"